@@ -0,0 +1,182 @@
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "checkpoint.h"
+#include "simulator.h"
+
+using namespace std;
+
+// offsets of the words of the header
+enum {
+    H_MAGIC = 0,
+    H_NUM_TAPES = 8,
+    H_NUM_STATES = 16,
+    H_NUM_LETTERS = 24,
+    H_DISTANCE = 32,
+    H_LATEST = 40,
+    H_END = 48,
+    H_WORD_LENGTH = 56,
+};
+
+// offsets of the words of a snapshot
+enum {
+    S_SIZE = 0,
+    S_STEPS = 8,
+    S_STATE = 16,
+    S_PREVIOUS = 24,
+    S_TAPES = 32,
+};
+
+static size_t cells_size(size_t length) {
+    return (2 * length + 7) / 8 * 8;
+}
+
+Checkpoint::Checkpoint(const string &filename_, const CompiledMachine &cm, bool create,
+                       const vector<symbol_t> &word_, unsigned long long snapshot_distance_)
+    : filename(filename_), num_tapes(cm.num_tapes), data(nullptr), capacity(0), latest_steps(0) {
+    fd = open(filename.c_str(), create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0644);
+    if (fd < 0)
+        machine_error(create ? "Cannot write to file " + filename : "File " + filename + " does not exist");
+    // the file is released first, since the destructor is not called if the error is thrown
+    auto fail = [&](const string &message) {
+        if (data)
+            munmap(data, capacity);
+        data = nullptr;
+        close(fd);
+        machine_error(message);
+    };
+
+    if (create) {
+        word = word_;
+        snapshot_distance = snapshot_distance_ ? snapshot_distance_ : 1;
+        size_t header_size = HEADER_WORDS * 8 + cells_size(word.size());
+        map(header_size + (1 << 16));
+        memcpy(data + H_MAGIC, CHECKPOINT_MAGIC, 8);
+        word_at(H_NUM_TAPES) = cm.num_tapes;
+        word_at(H_NUM_STATES) = cm.states.size();
+        word_at(H_NUM_LETTERS) = cm.letters.size();
+        word_at(H_DISTANCE) = snapshot_distance;
+        word_at(H_LATEST) = 0;
+        word_at(H_END) = header_size;
+        word_at(H_WORD_LENGTH) = word.size();
+        memcpy(data + HEADER_WORDS * 8, word.data(), 2 * word.size());
+        return;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || (size_t)file_stat.st_size < HEADER_WORDS * 8)
+        fail("Invalid checkpoint file");
+    map(file_stat.st_size);
+    if (memcmp(data + H_MAGIC, CHECKPOINT_MAGIC, 8) != 0 || word_at(H_END) > capacity
+            || HEADER_WORDS * 8 + cells_size(word_at(H_WORD_LENGTH)) > word_at(H_END)
+            || word_at(H_LATEST) + S_TAPES > word_at(H_END))
+        fail("Invalid checkpoint file");
+    if (word_at(H_NUM_TAPES) != (uint64_t)cm.num_tapes || word_at(H_NUM_STATES) != cm.states.size()
+            || word_at(H_NUM_LETTERS) != cm.letters.size())
+        fail("The checkpoint was not made for this machine");
+    snapshot_distance = word_at(H_DISTANCE);
+    word.resize(word_at(H_WORD_LENGTH));
+    memcpy(word.data(), data + HEADER_WORDS * 8, 2 * word.size());
+    for (symbol_t letter : word)
+        if (letter >= cm.letters.size())
+            fail("Invalid checkpoint file");
+    if (word_at(H_LATEST))
+        latest_steps = word_at(word_at(H_LATEST) + S_STEPS);
+}
+
+Checkpoint::~Checkpoint() {
+    if (data)
+        munmap(data, capacity);
+    close(fd);
+}
+
+void Checkpoint::map(size_t new_capacity) {
+    if (data)
+        munmap(data, capacity);
+    data = nullptr;
+    if (new_capacity > capacity && ftruncate(fd, new_capacity) != 0)
+        machine_error("Cannot write to file " + filename);
+    capacity = new_capacity;
+    void *address = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (address == MAP_FAILED)
+        machine_error("Cannot map file " + filename);
+    data = (unsigned char *)address;
+}
+
+void Checkpoint::save(const Simulator &sim) {
+    size_t size = S_TAPES;
+    for (const auto &tape : sim.tapes)
+        size += 3 * 8 + cells_size(tape.used_cells());
+    size_t offset = word_at(H_END);
+    if (offset + size > capacity)
+        map(max(2 * capacity, offset + size));
+
+    word_at(offset + S_SIZE) = size;
+    word_at(offset + S_STEPS) = sim.steps;
+    word_at(offset + S_STATE) = sim.state;
+    word_at(offset + S_PREVIOUS) = word_at(H_LATEST);
+    size_t pos = offset + S_TAPES;
+    for (int a = 0; a < num_tapes; ++a) {
+        const Tape &tape = sim.tapes[a];
+        word_at(pos) = (uint64_t)sim.heads[a];
+        word_at(pos + 8) = (uint64_t)tape.first_cell();
+        word_at(pos + 16) = tape.used_cells();
+        pos += 24;
+        symbol_t *cells = reinterpret_cast<symbol_t *>(data + pos);
+        for (long cell = tape.first_cell(); cell <= tape.last_cell(); ++cell)
+            *cells++ = tape.get(cell);
+        pos += cells_size(tape.used_cells());
+    }
+
+    // the snapshot has to be on the disk before the header points to it
+    if (msync(data, capacity, MS_SYNC) != 0)
+        machine_error("Cannot write to file " + filename);
+    word_at(H_LATEST) = offset;
+    word_at(H_END) = offset + size;
+    if (msync(data, HEADER_WORDS * 8, MS_SYNC) != 0)
+        machine_error("Cannot write to file " + filename);
+    latest_steps = sim.steps;
+}
+
+bool Checkpoint::restore(Simulator &sim, unsigned long long steps) const {
+    size_t end = word_at(H_END);
+    size_t offset = word_at(H_LATEST);
+    while (offset) {
+        // snapshots are linked from the later ones to the earlier ones
+        if (offset < HEADER_WORDS * 8 || offset + S_TAPES > end || word_at(offset + S_PREVIOUS) >= offset)
+            machine_error("Invalid checkpoint file");
+        if (word_at(offset + S_STEPS) <= steps)
+            break;
+        offset = word_at(offset + S_PREVIOUS);
+    }
+    if (!offset)
+        return false;
+    if (offset + word_at(offset + S_SIZE) > end || word_at(offset + S_STATE) >= sim.cm.states.size())
+        machine_error("Invalid checkpoint file");
+
+    sim.steps = word_at(offset + S_STEPS);
+    sim.state = (state_t)word_at(offset + S_STATE);
+    size_t pos = offset + S_TAPES;
+    for (int a = 0; a < num_tapes; ++a) {
+        long head = (long)word_at(pos);
+        long first = (long)word_at(pos + 8);
+        size_t length = word_at(pos + 16);
+        pos += 24;
+        // the used part of a tape contains cell 0 and the head, and the simulator trusts its letters
+        if (first > 0 || length > end || pos + cells_size(length) > offset + word_at(offset + S_SIZE)
+                || first + (long)length <= 0 || head < first || head >= first + (long)length)
+            machine_error("Invalid checkpoint file");
+        const symbol_t *cells = reinterpret_cast<const symbol_t *>(data + pos);
+        for (size_t b = 0; b < length; ++b)
+            if (cells[b] >= sim.cm.letters.size())
+                machine_error("Invalid checkpoint file");
+        sim.heads[a] = head;
+        sim.tapes[a].assign(vector<symbol_t>(cells, cells + length), first);
+        sim.tapes[a].reach(head);
+        pos += cells_size(length);
+    }
+    sim.resume();
+    return true;
+}
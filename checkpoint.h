@@ -0,0 +1,64 @@
+#ifndef __CHECKPOINT_H
+#define __CHECKPOINT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "compiled_machine.h"
+
+class Simulator;
+
+// A checkpoint file keeps snapshots of a long run (state, step count, heads and tapes),
+// so that the run can be resumed after a crash and any step can be reached quickly.
+// The file is memory-mapped; all numbers are 64-bit words in the native byte order:
+//   header: CHECKPOINT_MAGIC, num_tapes, number of states, number of letters, snapshot distance,
+//           offset of the latest snapshot (0 if none), end of the used part, input length, input letters
+//   snapshot: size, steps, state, offset of the previous snapshot (0 if none),
+//             (head first length cells)^k
+// Letters are 16-bit and padded to a whole word. A snapshot is written after the used part first
+// and only then linked from the header, so a crash leaves the previous snapshot the latest one.
+
+#define CHECKPOINT_MAGIC "TMCHKPT1"
+
+class Checkpoint {
+public:
+    std::vector<symbol_t> word; // the input of the run
+    unsigned long long snapshot_distance;
+
+    // creates a new file for a run on the word (with create), or opens an existing one;
+    // reports by machine_error a file which cannot be used or belongs to a different machine
+    Checkpoint(const std::string &filename, const CompiledMachine &cm, bool create,
+               const std::vector<symbol_t> &word_ = std::vector<symbol_t>(), unsigned long long snapshot_distance_ = 0);
+    ~Checkpoint();
+
+    Checkpoint(const Checkpoint &) = delete;
+    Checkpoint &operator=(const Checkpoint &) = delete;
+
+    bool snapshot_due(unsigned long long steps) const {
+        return steps >= latest_steps + snapshot_distance;
+    }
+
+    void save(const Simulator &sim);
+
+    // restores the latest snapshot taken at most after the given number of steps
+    // (the latest one at all by default); returns false if there is none
+    bool restore(Simulator &sim, unsigned long long steps = -1) const;
+
+private:
+    static const size_t HEADER_WORDS = 8;
+
+    std::string filename;
+    int fd;
+    int num_tapes;
+    unsigned char *data;
+    size_t capacity;
+    unsigned long long latest_steps;
+
+    uint64_t &word_at(size_t offset) const {
+        return *reinterpret_cast<uint64_t *>(data + offset);
+    }
+    void map(size_t new_capacity);
+};
+
+#endif
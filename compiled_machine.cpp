@@ -0,0 +1,534 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <tuple>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "compiled_machine.h"
+
+using namespace std;
+
+// the most entries of a dense table; a larger one is made sparse
+static const size_t MAX_DENSE_ENTRIES = 1u << 28;
+
+static tape_action_t pack_action(symbol_t letter, char dir) {
+    int move = dir == HEAD_LEFT ? -1 : dir == HEAD_RIGHT ? 1 : 0;
+    return ((tape_action_t)letter << 2) | (tape_action_t)(move + 1);
+}
+
+CompiledMachine::CompiledMachine(const TuringMachine &tm, const vector<string> &more_letters)
+    : num_tapes(tm.num_tapes), input_alphabet(tm.input_alphabet), sparse(false), mapped(nullptr), mapped_size(0) {
+    states = tm.set_of_states();
+    letters = tm.working_alphabet();
+    if (!more_letters.empty()) {
+        set<string> all(letters.begin(), letters.end());
+        all.insert(more_letters.begin(), more_letters.end());
+        letters.assign(all.begin(), all.end());
+    }
+    if (letters.size() > (1u << 14))
+        machine_error("Too many letters to compile the machine");
+    intern_names();
+
+    initial_state = state_ids.at(INITIAL_STATE);
+    accepting_state = state_ids.at(ACCEPTING_STATE);
+    rejecting_state = state_ids.at(REJECTING_STATE);
+    blank = letter_ids.at(BLANK);
+
+    // every index has to fit in size_t, even if the table is sparse
+    row_size = 1;
+    for (int a = 0; a < num_tapes; ++a) {
+        if (row_size > SIZE_MAX / letters.size())
+            too_large();
+        row_size *= letters.size();
+    }
+    if (states.size() > SIZE_MAX / row_size)
+        too_large();
+    stride = 1 + num_tapes;
+    if (states.size() * row_size > MAX_DENSE_ENTRIES)
+        make_sparse();
+    else {
+        own_table.assign(states.size() * row_size * stride, 0);
+        for (size_t idx = 0; idx < states.size() * row_size; ++idx)
+            own_table[idx * stride] = NO_TRANSITION;
+        own_sweep_of.assign(states.size() * row_size, NO_SWEEP);
+    }
+
+    for (const auto &transition : tm.transitions)
+        set_transition(transition);
+    update_pointers();
+
+    for (size_t state = 0; state < states.size(); ++state)
+        find_sweeps((state_t)state);
+}
+
+void CompiledMachine::too_large() const {
+    machine_error("The transition table of the machine is too large to compile");
+}
+
+void CompiledMachine::update_pointers() {
+    table = own_table.data();
+    sweep_of = own_sweep_of.data();
+    num_slots = own_sweep_of.size();
+}
+
+// returns the slot of the index in a sparse machine, adding an empty one if there is none
+uint32_t CompiledMachine::sparse_slot(size_t idx) {
+    auto it = sparse_slots.find(idx);
+    if (it != sparse_slots.end())
+        return it->second;
+    uint32_t slot = (uint32_t)slot_indices.size();
+    sparse_slots[idx] = slot;
+    slot_indices.push_back(idx);
+    state_slots[idx / row_size].push_back(slot);
+    own_table.resize(own_table.size() + stride, 0);
+    own_table[slot * stride] = NO_TRANSITION;
+    own_sweep_of.push_back(NO_SWEEP);
+    return slot;
+}
+
+// moves the transitions of the dense table (if any) to a sparse one
+void CompiledMachine::make_sparse() {
+    vector<uint32_t> dense_table, dense_sweep_of;
+    dense_table.swap(own_table);
+    dense_sweep_of.swap(own_sweep_of);
+    sparse = true;
+    own_table.assign(stride, 0);
+    own_table[0] = NO_TRANSITION;
+    own_sweep_of.assign(1, NO_SWEEP);
+    slot_indices.assign(1, 0);
+    state_slots.assign(states.size(), vector<uint32_t>());
+    for (size_t idx = 0; idx < dense_sweep_of.size(); ++idx) {
+        if (dense_table[idx * stride] == NO_TRANSITION)
+            continue;
+        uint32_t slot = sparse_slot(idx);
+        copy(&dense_table[idx * stride], &dense_table[(idx + 1) * stride], &own_table[slot * stride]);
+        own_sweep_of[slot] = dense_sweep_of[idx];
+    }
+}
+
+void CompiledMachine::set_transition(const transitions_t::value_type &transition) {
+    vector<symbol_t> before(num_tapes);
+    for (int a = 0; a < num_tapes; ++a)
+        before[a] = letter_ids.at(transition.first.second[a]);
+    size_t idx = index(state_ids.at(transition.first.first), before.data());
+    uint32_t *e = &own_table[(sparse ? sparse_slot(idx) : idx) * stride];
+    e[0] = state_ids.at(get<0>(transition.second));
+    for (int a = 0; a < num_tapes; ++a)
+        e[1 + a] = pack_action(letter_ids.at(get<1>(transition.second)[a]), get<2>(transition.second)[a]);
+}
+
+state_t CompiledMachine::add_state(const string &name) {
+    auto it = state_ids.find(name);
+    if (it != state_ids.end())
+        return it->second;
+    if (states.size() + 1 > SIZE_MAX / row_size)
+        too_large();
+    if (!sparse && (states.size() + 1) * row_size > MAX_DENSE_ENTRIES)
+        make_sparse();
+    state_t state = (state_t)states.size();
+    states.push_back(name);
+    state_ids[name] = state;
+    if (sparse)
+        state_slots.emplace_back();
+    else {
+        own_table.resize(states.size() * row_size * stride, 0);
+        for (size_t idx = state * row_size; idx < states.size() * row_size; ++idx)
+            own_table[idx * stride] = NO_TRANSITION;
+        own_sweep_of.resize(states.size() * row_size, NO_SWEEP);
+    }
+    update_pointers();
+    return state;
+}
+
+void CompiledMachine::add_transitions(const transitions_t &transitions) {
+    assert(!mapped);
+    set<state_t> changed;
+    for (const auto &transition : transitions) {
+        changed.insert(add_state(transition.first.first));
+        add_state(get<0>(transition.second));
+        set_transition(transition);
+    }
+    update_pointers();
+    for (state_t state : changed)
+        find_sweeps(state);
+}
+
+void CompiledMachine::intern_names() {
+    for (size_t a = 0; a < states.size(); ++a)
+        state_ids[states[a]] = (state_t)a;
+    for (size_t a = 0; a < letters.size(); ++a)
+        letter_ids[letters[a]] = (symbol_t)a;
+}
+
+// returns the tape moved by the sweep transition in the entry, or -1 if it is not a sweep
+static int sweep_tape(const CompiledMachine &cm, state_t state, const uint32_t *e, const symbol_t *letters_under_heads) {
+    if (e[0] != state)
+        return -1;
+    int tape = -1;
+    for (int a = 0; a < cm.num_tapes; ++a) {
+        if (action_letter(e[1 + a]) != letters_under_heads[a])
+            return -1;
+        if (action_move(e[1 + a]) != 0) {
+            if (tape != -1)
+                return -1;
+            tape = a;
+        }
+    }
+    return tape;
+}
+
+void CompiledMachine::find_sweeps(state_t state) {
+    // sweeps are grouped by (state, letters under the other heads, tape, move)
+    map<tuple<size_t, int, int>, uint32_t> groups;
+    vector<symbol_t> under_heads(num_tapes);
+    auto for_each_slot = [&](auto f) {
+        if (sparse)
+            for (uint32_t slot : state_slots[state])
+                f(slot);
+        else
+            for (size_t idx = state * row_size; idx < (state + 1) * row_size; ++idx)
+                f(idx);
+    };
+    // the old sweeps of the state are freed, so that regrouping it does not leave them behind
+    for_each_slot([&](size_t slot) {
+        uint32_t old = own_sweep_of[slot];
+        own_sweep_of[slot] = NO_SWEEP;
+        if (old != NO_SWEEP && !sweeps[old].members.empty()) {
+            sweeps[old].members.clear();
+            free_sweeps.push_back(old);
+        }
+    });
+    auto find_sweep = [&](size_t slot) {
+        size_t idx = index_of_slot(slot);
+        size_t rest = idx % row_size;
+        for (int a = 0; a < num_tapes; ++a) {
+            under_heads[a] = (symbol_t)(rest % letters.size());
+            rest /= letters.size();
+        }
+        int tape = sweep_tape(*this, state, entry_at(slot), under_heads.data());
+        if (tape == -1)
+            return;
+        size_t tape_multiplier = 1;
+        for (int a = 0; a < tape; ++a)
+            tape_multiplier *= letters.size();
+        int move = action_move(entry_at(slot)[1 + tape]);
+        auto key = make_tuple(idx - under_heads[tape] * tape_multiplier, tape, move);
+        auto it = groups.find(key);
+        if (it == groups.end()) {
+            if (free_sweeps.empty()) {
+                it = groups.emplace(key, (uint32_t)sweeps.size()).first;
+                sweeps.emplace_back();
+            } else {
+                it = groups.emplace(key, free_sweeps.back()).first;
+                free_sweeps.pop_back();
+            }
+            Sweep &sweep = sweeps[it->second];
+            sweep.tape = tape;
+            sweep.move = move;
+            sweep.member.assign(letters.size(), 0);
+        }
+        Sweep &sweep = sweeps[it->second];
+        sweep.member[under_heads[tape]] = 1;
+        sweep.members.push_back(under_heads[tape]);
+        own_sweep_of[slot] = it->second;
+    };
+    for_each_slot(find_sweep);
+}
+
+vector<symbol_t> CompiledMachine::encode(const vector<string> &word) const {
+    vector<symbol_t> res;
+    res.reserve(word.size());
+    for (const auto &letter : word)
+        res.push_back(letter_ids.at(letter));
+    return res;
+}
+
+vector<string> CompiledMachine::parse_input(const string &input) const {
+    return TuringMachine(num_tapes, input_alphabet, transitions_t()).parse_input(input);
+}
+
+TuringMachine CompiledMachine::to_turing_machine() const {
+    transitions_t transitions;
+    vector<string> letters_before(num_tapes), letters_after(num_tapes);
+    for (size_t slot = 0; slot < num_slots; ++slot) {
+        const uint32_t *e = entry_at(slot);
+        if (e[0] == NO_TRANSITION)
+            continue;
+        size_t idx = index_of_slot(slot);
+        size_t rest = idx % row_size;
+        string moves;
+        for (int a = 0; a < num_tapes; ++a, rest /= letters.size()) {
+            letters_before[a] = letters[rest % letters.size()];
+            letters_after[a] = letters[action_letter(e[1 + a])];
+            moves += "<->"[action_move(e[1 + a]) + 1];
+        }
+        transitions[make_pair(states[idx / row_size], letters_before)] = make_tuple(states[e[0]], letters_after, moves);
+    }
+    return TuringMachine(num_tapes, input_alphabet, transitions);
+}
+
+// offsets of the words of the header of a binary file
+enum {
+    H_MAGIC = 0,
+    H_NUM_TAPES = 8,
+    H_NUM_STATES = 16,
+    H_NUM_LETTERS = 24,
+    H_NUM_INPUT_LETTERS = 32,
+    H_INITIAL = 40,
+    H_ACCEPTING = 48,
+    H_REJECTING = 56,
+    H_BLANK = 64,
+    H_NUM_SWEEPS = 72,
+    H_NAMES = 80,
+    H_TABLE = 88,
+    H_SWEEP_OF = 96,
+    H_SWEEPS = 104,
+    H_SIZE = 112,
+    HEADER_SIZE = 120,
+};
+
+template<class T>
+static void put(string &data, T value) {
+    data.append((const char *)&value, sizeof(value));
+}
+
+static void pad(string &data) {
+    data.resize((data.size() + 7) / 8 * 8, 0);
+}
+
+bool CompiledMachine::save_binary(const string &filename) const {
+    if (sparse)
+        machine_error("The transition table of the machine is too large for the binary format");
+    string data(HEADER_SIZE, 0);
+    auto header = [&](size_t offset, uint64_t value) {
+        memcpy(&data[offset], &value, sizeof(value));
+    };
+    memcpy(&data[H_MAGIC], BINARY_MACHINE_MAGIC, 8);
+    header(H_NUM_TAPES, num_tapes);
+    header(H_NUM_STATES, states.size());
+    header(H_NUM_LETTERS, letters.size());
+    header(H_NUM_INPUT_LETTERS, input_alphabet.size());
+    header(H_INITIAL, initial_state);
+    header(H_ACCEPTING, accepting_state);
+    header(H_REJECTING, rejecting_state);
+    header(H_BLANK, blank);
+    header(H_NUM_SWEEPS, sweeps.size());
+
+    header(H_NAMES, data.size());
+    for (const auto *names : {&states, &letters, &input_alphabet})
+        for (const auto &name : *names) {
+            put(data, (uint32_t)name.length());
+            data += name;
+        }
+    pad(data);
+    size_t entries = states.size() * row_size;
+    header(H_TABLE, data.size());
+    data.append((const char *)table, entries * stride * sizeof(uint32_t));
+    pad(data);
+    header(H_SWEEP_OF, data.size());
+    data.append((const char *)sweep_of, entries * sizeof(uint32_t));
+    pad(data);
+    header(H_SWEEPS, data.size());
+    for (const auto &sweep : sweeps) {
+        put(data, (uint32_t)sweep.tape);
+        put(data, (uint32_t)(sweep.move + 1));
+        put(data, (uint32_t)sweep.members.size());
+        for (symbol_t letter : sweep.members)
+            put(data, letter);
+    }
+    pad(data);
+    header(H_SIZE, data.size());
+
+    ofstream output(filename, ios::binary);
+    return output && output.write(data.data(), data.size()) && output.flush();
+}
+
+bool is_binary_machine_file(const string &filename) {
+    ifstream input(filename, ios::binary);
+    char magic[8];
+    return input.read(magic, sizeof(magic)) && memcmp(magic, BINARY_MACHINE_MAGIC, sizeof(magic)) == 0;
+}
+
+bool has_binary_extension(const string &filename) {
+    const string extension = BINARY_MACHINE_EXTENSION;
+    return filename.length() > extension.length()
+        && filename.compare(filename.length() - extension.length(), extension.length(), extension) == 0;
+}
+
+CompiledMachine::CompiledMachine(const string &filename) : sparse(false), mapped(nullptr), mapped_size(0) {
+    // the file is unmapped first, since the destructor is not called if the error is thrown
+    auto fail = [&](const string &message) {
+        if (mapped)
+            munmap(mapped, mapped_size);
+        mapped = nullptr;
+        machine_error(message);
+    };
+    auto invalid = [&]() {
+        fail("Invalid binary machine file " + filename);
+    };
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        fail("File " + filename + " does not exist");
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || (size_t)file_stat.st_size < HEADER_SIZE) {
+        close(fd);
+        invalid();
+    }
+    mapped_size = file_stat.st_size;
+    mapped = mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        mapped = nullptr;
+        fail("Cannot map file " + filename);
+    }
+    const char *data = (const char *)mapped;
+    auto get = [&](size_t offset, size_t bytes) {
+        if (offset + bytes > mapped_size)
+            invalid();
+        uint64_t res = 0;
+        memcpy(&res, data + offset, bytes);
+        return res;
+    };
+
+    if (memcmp(data + H_MAGIC, BINARY_MACHINE_MAGIC, 8) != 0 || get(H_SIZE, 8) != mapped_size)
+        invalid();
+    uint64_t num_states = get(H_NUM_STATES, 8), num_letters = get(H_NUM_LETTERS, 8);
+    uint64_t tapes = get(H_NUM_TAPES, 8);
+    if (tapes == 0 || tapes > 16 || num_states == 0 || num_states > (1u << 28)
+            || num_letters == 0 || num_letters > (1u << 14))
+        invalid();
+    num_tapes = (int)tapes;
+    row_size = 1;
+    for (int a = 0; a < num_tapes; ++a) {
+        row_size *= num_letters;
+        if (row_size * num_states > MAX_DENSE_ENTRIES)
+            invalid();
+    }
+    stride = 1 + num_tapes;
+    size_t entries = num_states * row_size;
+    num_slots = entries;
+
+    size_t pos = get(H_NAMES, 8);
+    size_t table_offset = get(H_TABLE, 8), sweep_of_offset = get(H_SWEEP_OF, 8), sweeps_offset = get(H_SWEEPS, 8);
+    if (pos < HEADER_SIZE || table_offset % 8 || sweep_of_offset % 8
+            || table_offset < pos || sweep_of_offset < table_offset + entries * stride * sizeof(uint32_t)
+            || sweeps_offset < sweep_of_offset + entries * sizeof(uint32_t) || sweeps_offset > mapped_size)
+        invalid();
+    // the names are identifiers, distinct within each list
+    for (auto *names : {&states, &letters, &input_alphabet}) {
+        size_t count = names == &states ? num_states : names == &letters ? num_letters : get(H_NUM_INPUT_LETTERS, 8);
+        set<string> distinct;
+        for (size_t a = 0; a < count; ++a) {
+            size_t length = get(pos, 4);
+            if (pos + 4 + length > table_offset)
+                invalid();
+            names->emplace_back(data + pos + 4, length);
+            if (!is_identifier(names->back()) || !distinct.insert(names->back()).second)
+                invalid();
+            pos += 4 + length;
+        }
+    }
+    intern_names();
+    if (input_alphabet.empty())
+        invalid();
+    for (const auto &letter : input_alphabet)
+        if (letter == BLANK || !letter_ids.count(letter))
+            invalid();
+
+    initial_state = (state_t)get(H_INITIAL, 8);
+    accepting_state = (state_t)get(H_ACCEPTING, 8);
+    rejecting_state = (state_t)get(H_REJECTING, 8);
+    blank = (symbol_t)get(H_BLANK, 8);
+    if (initial_state >= num_states || accepting_state >= num_states || rejecting_state >= num_states
+            || blank >= num_letters || states[initial_state] != INITIAL_STATE || states[accepting_state] != ACCEPTING_STATE
+            || states[rejecting_state] != REJECTING_STATE || letters[blank] != BLANK)
+        invalid();
+
+    // the simulator trusts the table, so every entry is checked
+    table = (const uint32_t *)(data + table_offset);
+    sweep_of = (const uint32_t *)(data + sweep_of_offset);
+    uint64_t num_sweeps = get(H_NUM_SWEEPS, 8);
+    if (num_sweeps > mapped_size)
+        invalid();
+    for (size_t idx = 0; idx < entries; ++idx) {
+        const uint32_t *e = entry(idx);
+        if (e[0] != NO_TRANSITION && e[0] >= num_states)
+            invalid();
+        for (int a = 0; a < num_tapes; ++a)
+            if (action_letter(e[1 + a]) >= num_letters || (e[1 + a] & 3) == 3 || e[1 + a] >> 16)
+                invalid();
+        if (sweep_of[idx] != NO_SWEEP && sweep_of[idx] >= num_sweeps)
+            invalid();
+    }
+
+    pos = sweeps_offset;
+    for (uint64_t a = 0; a < num_sweeps; ++a) {
+        Sweep sweep;
+        uint64_t tape = get(pos, 4), move = get(pos + 4, 4);
+        size_t count = get(pos + 8, 4);
+        pos += 12;
+        if (tape >= (uint64_t)num_tapes || (move != 0 && move != 2) || count > num_letters)
+            invalid();
+        sweep.tape = (int)tape;
+        sweep.move = (int)move - 1;
+        sweep.member.assign(num_letters, 0);
+        for (size_t b = 0; b < count; ++b, pos += 2) {
+            symbol_t letter = (symbol_t)get(pos, 2);
+            if (letter >= num_letters || sweep.member[letter])
+                invalid();
+            sweep.member[letter] = 1;
+            sweep.members.push_back(letter);
+        }
+        sweeps.push_back(sweep);
+    }
+
+    // the simulator runs a sweep over its members without looking at their entries, so sweep_of has to
+    // match the table: the entries of a sweep are sweep transitions of a single group (as in find_sweeps),
+    // one for each of its members
+    vector<size_t> group_of(num_sweeps, SIZE_MAX), entries_of(num_sweeps, 0);
+    vector<symbol_t> under_heads(num_tapes);
+    for (size_t idx = 0; idx < entries; ++idx) {
+        if (sweep_of[idx] == NO_SWEEP)
+            continue;
+        const Sweep &sweep = sweeps[sweep_of[idx]];
+        size_t rest = idx % row_size, tape_multiplier = 1;
+        for (int a = 0; a < num_tapes; ++a, rest /= num_letters) {
+            under_heads[a] = (symbol_t)(rest % num_letters);
+            if (a < sweep.tape)
+                tape_multiplier *= num_letters;
+        }
+        if (sweep_tape(*this, (state_t)(idx / row_size), entry(idx), under_heads.data()) != sweep.tape
+                || action_move(entry(idx)[1 + sweep.tape]) != sweep.move || !sweep.member[under_heads[sweep.tape]])
+            invalid();
+        size_t group = idx - under_heads[sweep.tape] * tape_multiplier;
+        if (group_of[sweep_of[idx]] == SIZE_MAX)
+            group_of[sweep_of[idx]] = group;
+        else if (group_of[sweep_of[idx]] != group)
+            invalid();
+        ++entries_of[sweep_of[idx]];
+    }
+    for (size_t a = 0; a < num_sweeps; ++a)
+        if (entries_of[a] != sweeps[a].members.size())
+            invalid();
+}
+
+CompiledMachine::~CompiledMachine() {
+    if (mapped)
+        munmap(mapped, mapped_size);
+}
+
+unique_ptr<CompiledMachine> read_compiled_machine(const string &filename) {
+    if (is_binary_machine_file(filename))
+        return unique_ptr<CompiledMachine>(new CompiledMachine(filename));
+    FILE *f = fopen(filename.c_str(), "r");
+    if (!f)
+        machine_error("File " + filename + " does not exist");
+    return unique_ptr<CompiledMachine>(new CompiledMachine(read_tm_from_file(f)));
+}
@@ -0,0 +1,170 @@
+#ifndef __COMPILED_MACHINE_H
+#define __COMPILED_MACHINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "turing_machine.h"
+
+// A TuringMachine compiled for execution: every state and letter is interned
+// into a small integer and the transitions are stored in a dense table indexed
+// by (state, letters under the heads). The TuringMachine stays the source of
+// truth for names; the compiled form is used only to run the machine.
+// When the dense table would be too large, the table holds only the transitions
+// and a hash map finds the entry of an index (sparse machines cannot be saved).
+//
+// A compiled machine can be saved in a binary file (.tmb), which is memory-mapped when loaded,
+// so the machine runs with no parsing. All numbers are in the native byte order:
+//   header (64-bit words): BINARY_MACHINE_MAGIC, num_tapes, number of states, number of letters,
+//           number of input letters, initial state, accepting state, rejecting state, blank,
+//           number of sweeps, offsets of the names, the table, sweep_of and the sweeps, size of the file
+//   names: (length as a 32-bit word, characters)^* of the states, letters and input letters
+//   table: the 32-bit words of table, sweep_of: the 32-bit words of sweep_of
+//   sweeps: (tape, move + 1, number of members as 32-bit words, members as 16-bit words)^*
+// Every part starts at a multiple of 8 bytes. The magic holds the version of the format.
+
+typedef uint32_t state_t;
+typedef uint16_t symbol_t;
+
+#define NO_TRANSITION ((state_t)-1)
+
+// An action on a single tape is packed as (letter_to_write << 2) | (move + 1),
+// where move is -1, 0 or 1.
+typedef uint32_t tape_action_t;
+
+static inline symbol_t action_letter(tape_action_t action) {
+    return (symbol_t)(action >> 2);
+}
+
+static inline int action_move(tape_action_t action) {
+    return (int)(action & 3) - 1;
+}
+
+#define NO_SWEEP ((uint32_t)-1)
+
+#define BINARY_MACHINE_MAGIC "TMBIN001"
+#define BINARY_MACHINE_EXTENSION ".tmb"
+
+// A sweep transition (q, [a_1, ..., a_k]) -> (q, [a_1, ..., a_k], moves) changes nothing
+// but the position of a single head. A run of such transitions is executed at once
+// by scanning the tape for the first letter which does not continue the sweep.
+struct Sweep {
+    int tape;
+    int move;
+    std::vector<uint8_t> member; // letter -> does the sweep continue over it
+    std::vector<symbol_t> members; // the same set as a list (used when it is short)
+};
+
+struct CompiledMachine {
+    int num_tapes;
+
+    std::vector<std::string> states; // id -> name
+    std::vector<std::string> letters; // id -> name
+    std::map<std::string, state_t> state_ids;
+    std::map<std::string, symbol_t> letter_ids;
+
+    state_t initial_state, accepting_state, rejecting_state;
+    symbol_t blank;
+
+    size_t row_size; // number of entries per state, i.e. letters.size() ^ num_tapes
+    size_t stride; // words per entry: the next state followed by num_tapes actions
+
+    std::vector<std::string> input_alphabet;
+
+    bool sparse; // whether the table holds only the transitions, with the empty entry in slot 0
+    size_t num_slots; // number of entries in the table
+
+    const uint32_t *table; // in the machine itself or in its mapped file
+    // entry (state, [letter_1, ..., letter_k]) starts at table[slot(index(state, letters)) * stride]:
+    //    [next_state or NO_TRANSITION, action_on_tape_1, ..., action_on_tape_k]
+
+    std::vector<Sweep> sweeps;
+    const uint32_t *sweep_of; // slot -> index in sweeps or NO_SWEEP
+
+    // more_letters are added to the letters of the machine
+    explicit CompiledMachine(const TuringMachine &tm, const std::vector<std::string> &more_letters = std::vector<std::string>());
+
+    // loads a machine saved by save_binary; exits with an error if the file is not a valid one
+    explicit CompiledMachine(const std::string &filename);
+    ~CompiledMachine();
+
+    CompiledMachine(const CompiledMachine &) = delete;
+    CompiledMachine &operator=(const CompiledMachine &) = delete;
+
+    // returns false if writing failed
+    bool save_binary(const std::string &filename) const;
+
+    TuringMachine to_turing_machine() const;
+
+    // adds (or replaces) the transitions, with their new states; all their letters have to be known
+    void add_transitions(const transitions_t &transitions);
+
+    size_t index(state_t state, const symbol_t *letters_under_heads) const {
+        size_t res = 0;
+        for (int a = num_tapes - 1; a >= 0; --a)
+            res = res * letters.size() + letters_under_heads[a];
+        return state * row_size + res;
+    }
+
+    // the position of the entry of an index in the table, which is the index itself in a dense one
+    size_t slot(size_t idx) const {
+        if (!sparse)
+            return idx;
+        auto it = sparse_slots.find(idx);
+        return it == sparse_slots.end() ? 0 : it->second;
+    }
+
+    // the index of the entry in the slot
+    size_t index_of_slot(size_t slot) const {
+        return sparse ? slot_indices[slot] : slot;
+    }
+
+    const uint32_t *entry_at(size_t slot) const {
+        return &table[slot * stride];
+    }
+
+    const uint32_t *entry(size_t idx) const {
+        return entry_at(slot(idx));
+    }
+
+    std::vector<symbol_t> encode(const std::vector<std::string> &word) const;
+
+    // as TuringMachine::parse_input
+    std::vector<std::string> parse_input(const std::string &input) const;
+
+private:
+    std::vector<uint32_t> own_table, own_sweep_of; // when the machine is not mapped
+    void *mapped;
+    size_t mapped_size;
+
+    // only in a sparse machine
+    std::unordered_map<size_t, uint32_t> sparse_slots; // index -> slot
+    std::vector<size_t> slot_indices; // slot -> index
+    std::vector<std::vector<uint32_t>> state_slots; // state -> its slots
+
+    std::vector<uint32_t> free_sweeps; // sweeps of no slot (with no members), reused by find_sweeps
+
+    void find_sweeps(state_t state);
+    void make_sparse();
+    uint32_t sparse_slot(size_t idx);
+    void update_pointers();
+    void intern_names();
+    void set_transition(const transitions_t::value_type &transition);
+    state_t add_state(const std::string &name);
+    void too_large() const;
+};
+
+// whether the file holds a machine in the binary format
+bool is_binary_machine_file(const std::string &filename);
+
+// whether the name of the file ends with BINARY_MACHINE_EXTENSION
+bool has_binary_extension(const std::string &filename);
+
+// reads a machine from a text or a binary file (told apart by the magic); exits with an error if it cannot
+std::unique_ptr<CompiledMachine> read_compiled_machine(const std::string &filename);
+
+#endif
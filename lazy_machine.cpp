@@ -0,0 +1,15 @@
+#include "lazy_machine.h"
+
+using namespace std;
+
+LazyMachine::LazyMachine(const TuringMachine &tm)
+    : reduction(tm), cm(reduction.start_machine(), reduction.letters()) {
+}
+
+bool LazyMachine::make(state_t state, const symbol_t *under_heads) {
+    transitions_t transitions;
+    if (!reduction.make_transitions(cm.states[state], cm.letters[under_heads[0]], transitions))
+        return false;
+    cm.add_transitions(transitions);
+    return true;
+}
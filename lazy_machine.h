@@ -0,0 +1,27 @@
+#ifndef __LAZY_MACHINE_H
+#define __LAZY_MACHINE_H
+
+#include "compiled_machine.h"
+#include "turing_machine.h"
+
+// The one-tape reduction of a two-tape machine, compiled piece by piece while it runs:
+// the first time a run has no transition from a state on the letter under the head,
+// the transitions of the source transition the state belongs to are reduced and added to the machine.
+// A run of the machine makes the same steps as a run of the whole reduction.
+class LazyMachine {
+public:
+    explicit LazyMachine(const TuringMachine &tm);
+
+    const CompiledMachine &machine() const {
+        return cm;
+    }
+
+    // adds the transitions missing from the state on the letters under the heads; returns false if there are none
+    bool make(state_t state, const symbol_t *under_heads);
+
+private:
+    LazyReduction reduction;
+    CompiledMachine cm;
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include "libtm.h"
+#include "compiled_machine.h"
+#include "simulator.h"
+#include "turing_machine.h"
+
+using namespace std;
+
+static_assert((int)TM_RUNNING == (int)STATUS_RUNNING && (int)TM_ACCEPT == (int)STATUS_ACCEPT
+              && (int)TM_REJECT == (int)STATUS_REJECT && (int)TM_NO_TRANSITION == (int)STATUS_NO_TRANSITION
+              && (int)TM_FELL_OFF == (int)STATUS_FELL_OFF && (int)TM_LIMIT == (int)STATUS_LIMIT
+              && (int)TM_LOOP == (int)STATUS_LOOP, "tm_status has to match status_t");
+
+struct tm_machine {
+    unique_ptr<CompiledMachine> cm;
+};
+
+struct tm_simulator {
+    Simulator sim;
+};
+
+static void set_error(char **error, const string &message) {
+    if (!error)
+        return;
+    *error = (char *)malloc(message.length() + 1);
+    if (*error)
+        memcpy(*error, message.c_str(), message.length() + 1);
+}
+
+// calls make, which returns a new compiled machine; the errors are returned instead of ending the program
+template<class F>
+static tm_machine *make_machine(char **error, F make) {
+    if (error)
+        *error = nullptr;
+    MachineErrorScope scope;
+    try {
+        return new tm_machine{make()};
+    } catch (const MachineError &machine_error) {
+        set_error(error, machine_error.message);
+    } catch (const bad_alloc &) {
+        set_error(error, "Out of memory");
+    }
+    return nullptr;
+}
+
+tm_machine *tm_machine_load(const char *filename, char **error) {
+    return make_machine(error, [&]() {
+        return read_compiled_machine(filename);
+    });
+}
+
+tm_machine *tm_machine_parse(const char *text, size_t length, char **error) {
+    return make_machine(error, [&]() {
+        FILE *f = fmemopen((void *)text, length, "r");
+        if (!f)
+            machine_error("Cannot read a machine from memory");
+        return unique_ptr<CompiledMachine>(new CompiledMachine(read_tm_from_file(f)));
+    });
+}
+
+tm_machine *tm_machine_reduce(const tm_machine *machine, char **error) {
+    return make_machine(error, [&]() {
+        if (machine->cm->num_tapes != 2)
+            machine_error("Only a two-tape machine can be reduced");
+        TuringMachine tm = machine->cm->to_turing_machine();
+        return unique_ptr<CompiledMachine>(new CompiledMachine(tm.reduce_two_tapes_to_one()));
+    });
+}
+
+void tm_machine_free(tm_machine *machine) {
+    delete machine;
+}
+
+int tm_machine_num_tapes(const tm_machine *machine) {
+    return machine->cm->num_tapes;
+}
+
+void tm_free_error(char *error) {
+    free(error);
+}
+
+tm_simulator *tm_simulator_new(const tm_machine *machine) {
+    try {
+        return new tm_simulator{Simulator(*machine->cm)};
+    } catch (const bad_alloc &) {
+        return nullptr;
+    }
+}
+
+void tm_simulator_free(tm_simulator *simulator) {
+    delete simulator;
+}
+
+void tm_simulator_set_left_edge_extend(tm_simulator *simulator, int extend) {
+    simulator->sim.left_edge = extend ? LEFT_EDGE_EXTEND : LEFT_EDGE_REJECT;
+}
+
+void tm_simulator_set_max_cells(tm_simulator *simulator, unsigned long long max_cells) {
+    simulator->sim.max_cells = max_cells;
+}
+
+void tm_simulator_set_detect_cycles(tm_simulator *simulator, int detect_cycles) {
+    simulator->sim.detect_cycles = detect_cycles != 0;
+}
+
+int tm_simulator_start(tm_simulator *simulator, const char *word) {
+    const CompiledMachine &cm = simulator->sim.cm;
+    vector<string> letters = cm.parse_input(word);
+    if (letters.empty() && *word)
+        return -1;
+    simulator->sim.start(cm.encode(letters));
+    return 0;
+}
+
+tm_status tm_simulator_step(tm_simulator *simulator, unsigned long long num_steps) {
+    return (tm_status)simulator->sim.run_steps(num_steps);
+}
+
+tm_status tm_simulator_run(tm_simulator *simulator, unsigned long long max_steps) {
+    return (tm_status)simulator->sim.run(max_steps);
+}
+
+tm_status tm_simulator_status(const tm_simulator *simulator) {
+    return (tm_status)simulator->sim.status;
+}
+
+unsigned long long tm_simulator_steps(const tm_simulator *simulator) {
+    return simulator->sim.steps;
+}
+
+const char *tm_simulator_state(const tm_simulator *simulator) {
+    return simulator->sim.cm.states[simulator->sim.state].c_str();
+}
+
+unsigned long long tm_simulator_cycle_length(const tm_simulator *simulator) {
+    return simulator->sim.cycle_length;
+}
@@ -0,0 +1,76 @@
+#ifndef __LIBTM_H
+#define __LIBTM_H
+
+/* The C API of libtm.a: loading machines and running them, with no output and no exit on errors.
+   A machine is immutable once loaded, so any number of simulators (each owning its configuration)
+   can run it at once, on any threads; a single simulator must not be used by two threads at once. */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct tm_machine tm_machine;
+typedef struct tm_simulator tm_simulator;
+
+typedef enum {
+    TM_RUNNING,
+    TM_ACCEPT, /* the accepting state was reached */
+    TM_REJECT, /* the rejecting state was reached */
+    TM_NO_TRANSITION, /* rejected, as there is no transition from the configuration */
+    TM_FELL_OFF, /* rejected, as a head fell off the left end of its tape */
+    TM_LIMIT, /* the step or cell budget ran out; the run can be continued */
+    TM_LOOP /* the configuration repeated, so the machine never halts */
+} tm_status;
+
+/* Loads a machine in the text or the binary format. On failure returns NULL and, if error is not NULL,
+   sets *error to a message which has to be freed with tm_free_error. */
+tm_machine *tm_machine_load(const char *filename, char **error);
+
+/* Reads a machine in the text format from memory, as tm_machine_load. */
+tm_machine *tm_machine_parse(const char *text, size_t length, char **error);
+
+/* Reduces a two-tape machine to one tape (as tm_reducer does), as tm_machine_load. */
+tm_machine *tm_machine_reduce(const tm_machine *machine, char **error);
+
+void tm_machine_free(tm_machine *machine);
+
+int tm_machine_num_tapes(const tm_machine *machine);
+
+void tm_free_error(char *error);
+
+tm_simulator *tm_simulator_new(const tm_machine *machine);
+
+void tm_simulator_free(tm_simulator *simulator);
+
+/* the options, used by the runs started later */
+void tm_simulator_set_left_edge_extend(tm_simulator *simulator, int extend);
+void tm_simulator_set_max_cells(tm_simulator *simulator, unsigned long long max_cells);
+void tm_simulator_set_detect_cycles(tm_simulator *simulator, int detect_cycles);
+
+/* Starts a run on the word, which is written as in tm_interpreter (letters of the input alphabet one after
+   another). Returns 0, or -1 if the word is not over the input alphabet. */
+int tm_simulator_start(tm_simulator *simulator, const char *word);
+
+/* Makes at most num_steps more steps of the run. */
+tm_status tm_simulator_step(tm_simulator *simulator, unsigned long long num_steps);
+
+/* Runs until the machine halts or the step counter reaches max_steps (0 means no limit). */
+tm_status tm_simulator_run(tm_simulator *simulator, unsigned long long max_steps);
+
+tm_status tm_simulator_status(const tm_simulator *simulator);
+
+unsigned long long tm_simulator_steps(const tm_simulator *simulator);
+
+/* the name of the current state, valid as long as the machine */
+const char *tm_simulator_state(const tm_simulator *simulator);
+
+/* the length of the repeating cycle when the status is TM_LOOP, in steps */
+unsigned long long tm_simulator_cycle_length(const tm_simulator *simulator);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <map>
+#include "minimize.h"
+
+using namespace std;
+
+// A partition of the states into blocks, refined by splitting off the marked states of a block.
+// The states of a block lie together in elems, the marked ones at its beginning.
+class Partition {
+public:
+    vector<int> block_of, first, end;
+
+    Partition(const vector<int> &initial_blocks, int num_blocks)
+        : block_of(initial_blocks), first(num_blocks, 0), end(num_blocks, 0), mid(num_blocks, 0) {
+        for (int block : block_of)
+            ++end[block];
+        for (int b = 1; b < num_blocks; ++b)
+            end[b] += end[b - 1];
+        for (int b = 0; b < num_blocks; ++b)
+            first[b] = mid[b] = b ? end[b - 1] : 0;
+        elems.resize(block_of.size());
+        loc.resize(block_of.size());
+        vector<int> next = first;
+        for (size_t state = 0; state < block_of.size(); ++state) {
+            loc[state] = next[block_of[state]]++;
+            elems[loc[state]] = state;
+        }
+    }
+
+    int size() const {
+        return first.size();
+    }
+
+    int state_at(int pos) const {
+        return elems[pos];
+    }
+
+    void mark(int state) {
+        int b = block_of[state];
+        if (loc[state] < mid[b])
+            return;
+        if (mid[b] == first[b])
+            touched.push_back(b);
+        int other = elems[mid[b]];
+        swap(elems[loc[state]], elems[mid[b]]);
+        loc[other] = loc[state];
+        loc[state] = mid[b]++;
+    }
+
+    // splits the marked states off every touched block; calls new_block(old block, new block)
+    template<class F>
+    void split(F new_block) {
+        for (int b : touched) {
+            if (mid[b] == end[b]) {
+                mid[b] = first[b];
+                continue;
+            }
+            int nb = size();
+            first.push_back(first[b]);
+            end.push_back(mid[b]);
+            mid.push_back(first[b]);
+            first[b] = mid[b];
+            for (int pos = first[nb]; pos < end[nb]; ++pos)
+                block_of[elems[pos]] = nb;
+            new_block(b, nb);
+        }
+        touched.clear();
+    }
+
+private:
+    vector<int> mid, elems, loc;
+    vector<int> touched;
+};
+
+static bool is_halting(const string &state) {
+    return state == ACCEPTING_STATE || state == REJECTING_STATE;
+}
+
+TuringMachine minimize_machine(const TuringMachine &tm) {
+    // the states reachable from the initial one, with the ranges of their transitions
+    vector<string> names = {INITIAL_STATE};
+    map<string, int> ids = {{INITIAL_STATE, 0}};
+    vector<pair<transitions_t::const_iterator, transitions_t::const_iterator>> ranges;
+    for (size_t state = 0; state < names.size(); ++state) {
+        auto begin = tm.transitions.lower_bound(make_pair(names[state], vector<string>()));
+        auto it = begin;
+        if (!is_halting(names[state]))
+            for (; it != tm.transitions.end() && it->first.first == names[state]; ++it)
+                if (ids.emplace(get<0>(it->second), names.size()).second)
+                    names.emplace_back(get<0>(it->second));
+        ranges.emplace_back(begin, it);
+    }
+    int num_states = names.size();
+
+    // the initial blocks: states with the same actions on the same letters
+    map<vector<string>, int> symbols;
+    map<pair<vector<string>, string>, int> actions;
+    map<vector<pair<int, int>>, int> signatures;
+    vector<int> initial_blocks(num_states);
+    vector<vector<pair<int, int>>> inverse(num_states); // state -> (symbol, state with a transition to it)
+    for (int state = 0; state < num_states; ++state) {
+        vector<pair<int, int>> signature;
+        if (names[state] == ACCEPTING_STATE)
+            signature.emplace_back(-1, 0);
+        else if (names[state] == REJECTING_STATE)
+            signature.emplace_back(-1, 1);
+        for (auto it = ranges[state].first; it != ranges[state].second; ++it) {
+            int symbol = symbols.emplace(it->first.second, symbols.size()).first->second;
+            auto action = make_pair(get<1>(it->second), get<2>(it->second));
+            signature.emplace_back(symbol, actions.emplace(action, actions.size()).first->second);
+            inverse[ids[get<0>(it->second)]].emplace_back(symbol, state);
+        }
+        sort(signature.begin(), signature.end());
+        initial_blocks[state] = signatures.emplace(signature, signatures.size()).first->second;
+    }
+
+    // Hopcroft's refinement; all the initial blocks are splitters, since the transitions are partial
+    Partition partition(initial_blocks, signatures.size());
+    vector<int> work;
+    vector<bool> in_work(partition.size(), true);
+    for (int b = 0; b < partition.size(); ++b)
+        work.push_back(b);
+    vector<pair<int, int>> preimage;
+    while (!work.empty()) {
+        int splitter = work.back();
+        work.pop_back();
+        in_work[splitter] = false;
+        preimage.clear();
+        for (int pos = partition.first[splitter]; pos < partition.end[splitter]; ++pos) {
+            const auto &edges = inverse[partition.state_at(pos)];
+            preimage.insert(preimage.end(), edges.begin(), edges.end());
+        }
+        sort(preimage.begin(), preimage.end());
+        for (size_t a = 0; a < preimage.size();) {
+            size_t b = a;
+            for (; b < preimage.size() && preimage[b].first == preimage[a].first; ++b)
+                partition.mark(preimage[b].second);
+            a = b;
+            partition.split([&](int old_block, int new_block) {
+                in_work.push_back(false);
+                int smaller = new_block;
+                if (!in_work[old_block] && partition.end[old_block] - partition.first[old_block]
+                        < partition.end[new_block] - partition.first[new_block])
+                    smaller = old_block;
+                if (!in_work[smaller]) {
+                    in_work[smaller] = true;
+                    work.push_back(smaller);
+                }
+            });
+        }
+    }
+
+    // a block is named after the least of its states, the initial one keeps its name
+    vector<int> representative(partition.size(), -1);
+    for (int state = 0; state < num_states; ++state) {
+        int &r = representative[partition.block_of[state]];
+        if (r == -1 || (r != 0 && (state == 0 || names[state] < names[r])))
+            r = state;
+    }
+    transitions_t res;
+    for (int b = 0; b < partition.size(); ++b) {
+        int state = representative[b];
+        for (auto it = ranges[state].first; it != ranges[state].second; ++it) {
+            auto out = it->second;
+            get<0>(out) = names[representative[partition.block_of[ids[get<0>(out)]]]];
+            res[it->first] = out;
+        }
+    }
+    return TuringMachine(tm.num_tapes, tm.input_alphabet, res);
+}
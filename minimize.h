@@ -0,0 +1,14 @@
+#ifndef __MINIMIZE_H
+#define __MINIMIZE_H
+
+#include "turing_machine.h"
+
+// Drops the states which cannot be reached from the initial state and merges the equivalent states,
+// i.e. ones which on every letters under the heads write the same letters, make the same moves
+// and go to equivalent states (or have no transition on them); the accepting and rejecting states
+// are never merged with any other. The states are merged by partition refinement (Hopcroft's algorithm).
+// The result runs on every input exactly as the machine does, step by step.
+// A merged state is named after the least of its states, the initial one keeps its name.
+TuringMachine minimize_machine(const TuringMachine &tm);
+
+#endif
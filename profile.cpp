@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include "profile.h"
+#include "simulator.h"
+#include "turing_machine.h"
+
+using namespace std;
+
+Profiler::Profiler(const CompiledMachine &cm_)
+    : cm(cm_), hits(cm_.num_slots, 0), travel(cm_.num_tapes, 0) {
+}
+
+// skips the identifier starting at pos; returns false if there is none
+static bool skip_identifier(const string &name, size_t &pos) {
+    if (pos >= name.length())
+        return false;
+    if (name[pos] != '(') {
+        ++pos;
+        return true;
+    }
+    int depth = 0;
+    do {
+        if (name[pos] == '(')
+            ++depth;
+        else if (name[pos] == ')')
+            --depth;
+        ++pos;
+    } while (depth > 0 && pos < name.length());
+    return depth == 0;
+}
+
+string state_family(const string &state) {
+    const string prefix = "(U-";
+    if (state.compare(0, prefix.length(), prefix) != 0 || state.back() != ')')
+        return state;
+    // (U-<original state>[-(<letter>)-(<letter>)]-<move>-<tape>)
+    size_t pos = prefix.length();
+    if (!skip_identifier(state, pos))
+        return state;
+    while (pos + 1 < state.length() && state[pos] == '-' && state[pos + 1] == '(') {
+        ++pos;
+        if (!skip_identifier(state, pos))
+            return state;
+    }
+    size_t last_dash = state.rfind('-');
+    if (pos >= state.length() || state[pos] != '-' || last_dash <= pos)
+        return state;
+    string move = state.substr(pos + 1, last_dash - pos - 1);
+    for (string kind : {"extendTape-", "backToFirstTape-"})
+        if (move.compare(0, kind.length(), kind) == 0)
+            move = kind + "*";
+    return prefix + "*-" + move + state.substr(last_dash);
+}
+
+vector<Profiler::Count> Profiler::transition_counts() const {
+    vector<Count> res;
+    vector<symbol_t> letters(cm.num_tapes);
+    for (size_t slot = 0; slot < hits.size(); ++slot) {
+        if (!hits[slot])
+            continue;
+        size_t idx = cm.index_of_slot(slot);
+        size_t rest = idx % cm.row_size;
+        for (int a = 0; a < cm.num_tapes; ++a, rest /= cm.letters.size())
+            letters[a] = (symbol_t)(rest % cm.letters.size());
+        const uint32_t *e = cm.entry_at(slot);
+        string name = cm.states[idx / cm.row_size];
+        for (int a = 0; a < cm.num_tapes; ++a)
+            name += " " + cm.letters[letters[a]];
+        name += " -> " + cm.states[e[0]];
+        for (int a = 0; a < cm.num_tapes; ++a)
+            name += " " + cm.letters[action_letter(e[1 + a])];
+        for (int a = 0; a < cm.num_tapes; ++a)
+            name += string(" ") + "<->"[action_move(e[1 + a]) + 1];
+        res.push_back({name, hits[slot]});
+    }
+    return res;
+}
+
+vector<Profiler::Count> Profiler::state_counts() const {
+    vector<unsigned long long> sums(cm.states.size(), 0);
+    for (size_t slot = 0; slot < hits.size(); ++slot)
+        if (hits[slot])
+            sums[cm.index_of_slot(slot) / cm.row_size] += hits[slot];
+    vector<Count> res;
+    for (size_t state = 0; state < cm.states.size(); ++state)
+        if (sums[state])
+            res.push_back({cm.states[state], sums[state]});
+    return res;
+}
+
+vector<Profiler::Count> Profiler::family_counts() const {
+    map<string, unsigned long long> families;
+    for (const auto &count : state_counts())
+        families[state_family(count.name)] += count.hits;
+    vector<Count> res;
+    for (const auto &family : families)
+        res.push_back({family.first, family.second});
+    return res;
+}
+
+void Profiler::shift_counts(unsigned long long &passes, unsigned long long &saved) const {
+    passes = saved = 0;
+    const string border = "-extendTape-tapeBorder-1)";
+    for (const auto &count : state_counts())
+        if (count.name.length() > border.length()
+                && count.name.compare(count.name.length() - border.length(), border.length(), border) == 0)
+            passes += count.hits;
+    for (size_t slot = 0; slot < hits.size(); ++slot) {
+        size_t idx = cm.index_of_slot(slot);
+        if (hits[slot] && state_family(cm.states[idx / cm.row_size]) == "(U-*-headRight-1)"
+                && is_tape_padding(cm.letters[idx % cm.row_size % cm.letters.size()]))
+            saved += hits[slot];
+    }
+}
+
+static void sort_counts(vector<Profiler::Count> &counts) {
+    stable_sort(counts.begin(), counts.end(), [](const Profiler::Count &a, const Profiler::Count &b) {
+        return a.hits > b.hits;
+    });
+}
+
+static void print_counts(ostream &output, const string &title, vector<Profiler::Count> counts,
+                         unsigned long long steps, size_t top) {
+    sort_counts(counts);
+    output << title << " (" << min(top, counts.size()) << " of " << counts.size() << "):\n";
+    for (size_t a = 0; a < counts.size() && a < top; ++a)
+        output << setw(14) << counts[a].hits << " " << setw(6) << fixed << setprecision(2)
+               << (steps ? 100.0 * counts[a].hits / steps : 0.0) << "%  " << counts[a].name << "\n";
+}
+
+void Profiler::print_report(ostream &output, const Simulator &sim, size_t top) const {
+    output << "Profile of " << sim.steps << " steps\n";
+    print_counts(output, "Families", family_counts(), sim.steps, (size_t)-1);
+    print_counts(output, "States", state_counts(), sim.steps, top);
+    print_counts(output, "Transitions", transition_counts(), sim.steps, top);
+    unsigned long long passes, saved;
+    shift_counts(passes, saved);
+    if (passes || saved)
+        output << "Shift passes: " << passes << ", saved by the padding: " << saved << "\n";
+    for (int a = 0; a < cm.num_tapes; ++a)
+        output << "Tape " << a + 1 << ": head travel " << travel[a] << ", extent " << sim.tapes[a].used_cells()
+               << " cells [" << sim.tapes[a].first_cell() << ", " << sim.tapes[a].last_cell() << "]\n";
+}
+
+static void print_json_counts(ostream &output, const string &name, vector<Profiler::Count> counts) {
+    sort_counts(counts);
+    output << "  \"" << name << "\": [";
+    for (size_t a = 0; a < counts.size(); ++a)
+        output << (a ? ",\n" : "\n") << "    {\"name\": \"" << counts[a].name << "\", \"hits\": " << counts[a].hits << "}";
+    output << "\n  ],\n";
+}
+
+void Profiler::print_json(ostream &output, const Simulator &sim) const {
+    unsigned long long passes, saved;
+    shift_counts(passes, saved);
+    output << "{\n  \"steps\": " << sim.steps << ",\n  \"shift_passes\": " << passes
+           << ",\n  \"saved_shift_passes\": " << saved << ",\n";
+    print_json_counts(output, "families", family_counts());
+    print_json_counts(output, "states", state_counts());
+    print_json_counts(output, "transitions", transition_counts());
+    output << "  \"tapes\": [";
+    for (int a = 0; a < cm.num_tapes; ++a)
+        output << (a ? ",\n" : "\n") << "    {\"tape\": " << a + 1 << ", \"head_travel\": " << travel[a]
+               << ", \"extent\": " << sim.tapes[a].used_cells() << ", \"first_cell\": " << sim.tapes[a].first_cell()
+               << ", \"last_cell\": " << sim.tapes[a].last_cell() << "}";
+    output << "\n  ]\n}\n";
+}
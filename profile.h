@@ -0,0 +1,52 @@
+#ifndef __PROFILE_H
+#define __PROFILE_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "compiled_machine.h"
+
+class Simulator;
+
+// Counts of a run: hits of every transition, the travel of every head and the extent of every tape.
+// Counting a step is a single increment, so the profile can be left on in long runs.
+// The counts per state and per family of states are summed up from the transitions in the report.
+class Profiler {
+public:
+    struct Count {
+        std::string name;
+        unsigned long long hits;
+    };
+
+    explicit Profiler(const CompiledMachine &cm_);
+
+    void step(size_t slot, const uint32_t *actions) {
+        ++hits[slot];
+        for (size_t a = 0; a < travel.size(); ++a)
+            travel[a] += action_move(actions[a]) != 0;
+    }
+
+    // a sorted report, with at most top transitions and states
+    void print_report(std::ostream &output, const Simulator &sim, size_t top = 20) const;
+    void print_json(std::ostream &output, const Simulator &sim) const;
+
+private:
+    const CompiledMachine &cm;
+    std::vector<unsigned long long> hits; // slot of the entry -> number of steps done by it
+    std::vector<unsigned long long> travel; // tape -> number of moves of its head
+
+    std::vector<Count> transition_counts() const;
+    std::vector<Count> state_counts() const;
+    std::vector<Count> family_counts() const;
+    // passes shifting the second tape of a reduced machine to make room for the first one,
+    // and steps of the first head onto the padding, each of which saved such a pass
+    void shift_counts(unsigned long long &passes, unsigned long long &saved) const;
+};
+
+// the family of a state made by the reduction: (U-<state>-<move>-<tape>) belongs to (U-*-<move>-<tape>),
+// where the letter in extendTape-<letter> and backToFirstTape-<letter> is replaced by *;
+// any other state is a family of its own
+std::string state_family(const std::string &state);
+
+#endif
@@ -0,0 +1,256 @@
+#include <sstream>
+#include "simulator.h"
+#include "lazy_machine.h"
+#include "trace.h"
+#include "profile.h"
+
+using namespace std;
+
+static const uint64_t HASH_BASE = 0x9E3779B97F4A7C15ull; // odd, so it is invertible modulo 2^64
+
+static uint64_t inverse(uint64_t x) {
+    uint64_t res = x; // Newton's iteration, every step doubles the number of correct bits
+    for (int a = 0; a < 6; ++a)
+        res *= 2 - x * res;
+    return res;
+}
+
+static const uint64_t HASH_BASE_INVERSE = inverse(HASH_BASE);
+
+static uint64_t power(uint64_t base, unsigned long long exp) {
+    uint64_t res = 1;
+    for (; exp; exp >>= 1, base *= base)
+        if (exp & 1)
+            res *= base;
+    return res;
+}
+
+static uint64_t tape_weight(size_t tape) {
+    return 2 * tape + 1;
+}
+
+// how far a sweep over blanks beyond the used part of the tape goes in a single step() call
+static const long RUNAWAY_SWEEP = 1 << 16;
+
+Simulator::Simulator(const CompiledMachine &cm_)
+    : cm(cm_), tapes(cm_.num_tapes, Tape(cm_.blank)), heads(cm_.num_tapes), under_heads(cm_.num_tapes) {
+    start(vector<symbol_t>());
+}
+
+void Simulator::start(const vector<symbol_t> &word) {
+    tapes[0].assign(word);
+    for (size_t a = 1; a < tapes.size(); ++a)
+        tapes[a].assign(vector<symbol_t>());
+    heads.assign(cm.num_tapes, 0);
+    state = cm.initial_state;
+    steps = 0;
+    resume();
+    if (trace)
+        trace->snapshot(*this);
+}
+
+void Simulator::resume() {
+    status = STATUS_RUNNING;
+    fallen_tape = -1;
+    cycle_length = 0;
+
+    if (detect_cycles) {
+        head_power.resize(cm.num_tapes);
+        tapes_hash = 0;
+        for (size_t a = 0; a < tapes.size(); ++a) {
+            const Tape &tape = tapes[a];
+            uint64_t pos_power = tape.first_cell() < 0 ? power(HASH_BASE_INVERSE, -tape.first_cell()) : 1;
+            for (long pos = tape.first_cell(); pos <= tape.last_cell(); ++pos, pos_power *= HASH_BASE)
+                tapes_hash += tape_weight(a) * (tape.get(pos) ^ cm.blank) * pos_power;
+            head_power[a] = heads[a] < 0 ? power(HASH_BASE_INVERSE, -heads[a]) : power(HASH_BASE, heads[a]);
+        }
+        checkpoint_power = 1;
+        save_checkpoint();
+    }
+}
+
+void Simulator::move_head(int tape, long distance) {
+    heads[tape] += distance;
+    tapes[tape].reach(heads[tape]);
+    if (detect_cycles) {
+        if (distance == 1 || distance == -1)
+            head_power[tape] *= distance > 0 ? HASH_BASE : HASH_BASE_INVERSE;
+        else
+            head_power[tape] *= power(distance > 0 ? HASH_BASE : HASH_BASE_INVERSE, distance > 0 ? distance : -distance);
+    }
+}
+
+uint64_t Simulator::configuration_hash() const {
+    uint64_t res = tapes_hash;
+    res = res * HASH_BASE + state;
+    for (long head : heads)
+        res = res * HASH_BASE + (uint64_t)head;
+    return res;
+}
+
+void Simulator::save_checkpoint() {
+    checkpoint.state = state;
+    checkpoint.heads = heads;
+    checkpoint.tapes = tapes;
+    checkpoint.hash = configuration_hash();
+    checkpoint.steps = steps;
+    checkpoint_distance = 0;
+}
+
+void Simulator::check_budgets_and_cycles() {
+    if (max_cells) {
+        unsigned long long cells = 0;
+        for (const auto &tape : tapes)
+            cells += tape.used_cells();
+        if (cells > max_cells) {
+            status = STATUS_LIMIT;
+            return;
+        }
+    }
+    if (!detect_cycles)
+        return;
+    if (configuration_hash() == checkpoint.hash && state == checkpoint.state && heads == checkpoint.heads) {
+        bool same = true;
+        for (size_t a = 0; a < tapes.size() && same; ++a)
+            same = tapes[a].same_contents(checkpoint.tapes[a]);
+        if (same) {
+            cycle_length = steps - checkpoint.steps;
+            status = STATUS_LOOP;
+            return;
+        }
+    }
+    if (++checkpoint_distance == checkpoint_power) {
+        checkpoint_power *= 2;
+        save_checkpoint();
+    }
+}
+
+// executes the whole run of a sweep at once;
+// returns false if not even a single step could be done this way
+bool Simulator::execute_sweep(size_t slot, unsigned long long max_steps) {
+    const Sweep &sweep = cm.sweeps[cm.sweep_of[slot]];
+    const Tape &tape = tapes[sweep.tape];
+    long head = heads[sweep.tape];
+    long n = 1 + tape.scan(head + sweep.move, sweep);
+    long target = head + n * sweep.move;
+    if (left_edge == LEFT_EDGE_REJECT && target < 0)
+        --n; // the head falls off the tape in the last step, it is reported by a single step
+    else if ((target > tape.last_cell() || target < tape.first_cell()) && sweep.member[cm.blank])
+        n += RUNAWAY_SWEEP; // the head left the used part of the tape and the sweep continues over blanks forever
+    if (max_steps && (unsigned long long)n > max_steps - steps)
+        n = (long)(max_steps - steps);
+    if (max_cells) {
+        // the sweep stops at the first cell over the budget, as a run step by step does
+        unsigned long long cells = 0;
+        for (const auto &other : tapes)
+            cells += other.used_cells();
+        long used_ahead = sweep.move > 0 ? tape.last_cell() - head : head - tape.first_cell();
+        if (cells > max_cells)
+            n = 1; // a run over the budget stops after a single step
+        else if (n > used_ahead && (unsigned long long)(n - used_ahead) > max_cells + 1 - cells)
+            n = used_ahead + (long)(max_cells + 1 - cells);
+    }
+    if (n == 0)
+        return false;
+    if (profile) {
+        // every step of the sweep is a hit of the transition on the letter it passes over
+        for (long k = 0; k < n; ++k) {
+            under_heads[sweep.tape] = tape.get_or_blank(head + k * sweep.move);
+            size_t passed = cm.slot(cm.index(state, under_heads.data()));
+            profile->step(passed, cm.entry_at(passed) + 1);
+        }
+    }
+    move_head(sweep.tape, n * sweep.move);
+    steps += n;
+    if (trace)
+        trace->sweep(sweep.tape, n * sweep.move);
+    return true;
+}
+
+status_t Simulator::step(unsigned long long max_steps) {
+    if (status == STATUS_LIMIT)
+        status = STATUS_RUNNING;
+    if (status != STATUS_RUNNING)
+        return status;
+    if (max_steps && steps >= max_steps)
+        return status = STATUS_LIMIT;
+
+    for (size_t a = 0; a < tapes.size(); ++a)
+        under_heads[a] = tapes[a].get(heads[a]);
+    size_t slot = cm.slot(cm.index(state, under_heads.data()));
+    if (use_sweeps && cm.sweep_of[slot] != NO_SWEEP && execute_sweep(slot, max_steps)) {
+        check_budgets_and_cycles();
+        if (trace && trace->snapshot_due(steps))
+            trace->snapshot(*this);
+        return status;
+    }
+
+    const uint32_t *trans = cm.entry_at(slot);
+    if (trans[0] == NO_TRANSITION) {
+        if (lazy && lazy->make(state, under_heads.data()))
+            return step(max_steps);
+        return status = STATUS_NO_TRANSITION;
+    }
+    state = trans[0];
+    for (size_t a = 0; a < tapes.size(); ++a) {
+        symbol_t letter = action_letter(trans[1 + a]);
+        tapes[a].set(heads[a], letter);
+        if (detect_cycles)
+            tapes_hash += tape_weight(a) * ((uint64_t)(letter ^ cm.blank) - (uint64_t)(under_heads[a] ^ cm.blank)) * head_power[a];
+        int move = action_move(trans[1 + a]);
+        if (move < 0 && !heads[a] && left_edge == LEFT_EDGE_REJECT) {
+            fallen_tape = (int)a;
+            return status = STATUS_FELL_OFF;
+        }
+        if (move)
+            move_head((int)a, move);
+    }
+    ++steps;
+    if (trace)
+        trace->step(state, trans + 1);
+    if (profile)
+        profile->step(slot, trans + 1);
+
+    if (state == cm.rejecting_state)
+        status = STATUS_REJECT;
+    else if (state == cm.accepting_state)
+        status = STATUS_ACCEPT;
+    else
+        check_budgets_and_cycles();
+    if (trace && trace->snapshot_due(steps))
+        trace->snapshot(*this);
+    return status;
+}
+
+status_t Simulator::run(unsigned long long max_steps) {
+    while (step(max_steps) == STATUS_RUNNING);
+    return status;
+}
+
+status_t Simulator::run_steps(unsigned long long num_steps) {
+    if (!num_steps)
+        return status;
+    return run(steps + num_steps);
+}
+
+void Simulator::print_configuration(ostream &output) const {
+    // the whole configuration is built first and written at once
+    ostringstream res;
+    res << "State: " << cm.states[state] << "\n";
+    for (size_t a = 0; a < tapes.size(); ++a) {
+        const Tape &tape = tapes[a];
+        size_t before_head = 0, after_head = 0;
+        string line = "Tape " + to_string(a + 1) + ": ";
+        for (long b = tape.first_cell(); b <= tape.last_cell(); ++b) {
+            if (b == heads[a])
+                before_head = line.length();
+            line += cm.letters[tape.get(b)];
+            if (b == heads[a])
+                after_head = line.length();
+        }
+        res << line << "\n"
+            << string(before_head, ' ') << string(after_head - before_head, '^') << "\n";
+    }
+    res << "#####################################\n";
+    output << res.str();
+}
@@ -0,0 +1,93 @@
+#ifndef __SIMULATOR_H
+#define __SIMULATOR_H
+
+#include <ostream>
+#include <vector>
+#include "compiled_machine.h"
+#include "tape.h"
+
+enum status_t {
+    STATUS_RUNNING,
+    STATUS_ACCEPT, // the accepting state was reached
+    STATUS_REJECT, // the rejecting state was reached
+    STATUS_NO_TRANSITION, // rejected, as there is no transition from the configuration
+    STATUS_FELL_OFF, // rejected, as a head fell off the left end of its tape
+    STATUS_LIMIT, // the step or cell budget ran out
+    STATUS_LOOP, // the configuration repeated, so the machine never halts
+};
+
+// A run of a compiled machine on a single input. It owns its configuration,
+// so many runs of the same machine can be simulated at once.
+class TraceWriter;
+class Profiler;
+class LazyMachine;
+
+class Simulator {
+public:
+    const CompiledMachine &cm;
+
+    bool use_sweeps = true;
+    left_edge_t left_edge = LEFT_EDGE_REJECT;
+    unsigned long long max_cells = 0; // on all tapes together, 0 means no limit
+    bool detect_cycles = false; // has to be set before start()
+    TraceWriter *trace = nullptr; // records the run, has to be set before start()
+    Profiler *profile = nullptr; // counts the steps of the run
+    LazyMachine *lazy = nullptr; // makes the missing transitions of cm, which has to be its machine
+
+    std::vector<Tape> tapes;
+    std::vector<long> heads;
+    state_t state;
+    unsigned long long steps;
+    status_t status;
+    int fallen_tape; // for STATUS_FELL_OFF
+    unsigned long long cycle_length; // for STATUS_LOOP, in steps
+
+    explicit Simulator(const CompiledMachine &cm_);
+
+    // starts a new run; the tapes are reused
+    void start(const std::vector<symbol_t> &word);
+
+    // continues a run from a configuration set directly (state, steps, heads and tapes),
+    // e.g. restored from a snapshot
+    void resume();
+
+    // executes a single step (or a whole sweep, if sweeps are used)
+    // as long as the step counter stays below max_steps (0 means no limit)
+    status_t step(unsigned long long max_steps = 0);
+
+    // runs the machine until it halts or the step counter reaches max_steps (0 means no limit)
+    status_t run(unsigned long long max_steps = 0);
+
+    // runs the machine until it halts or makes num_steps more steps
+    status_t run_steps(unsigned long long num_steps);
+
+    // prints the state and the tapes with the positions of the heads marked below them
+    void print_configuration(std::ostream &output) const;
+
+private:
+    std::vector<symbol_t> under_heads;
+
+    // Cycle detection in the style of Brent: the configuration is compared with the one
+    // saved at the last checkpoint, and checkpoints are taken at exponentially growing distances.
+    // Configurations are compared by a hash maintained incrementally while the machine runs:
+    // sum over the tapes and cells of weight(tape) * (letter ^ blank) * R^position,
+    // and only configurations with equal hashes are compared cell by cell.
+    struct Checkpoint {
+        state_t state;
+        std::vector<long> heads;
+        std::vector<Tape> tapes;
+        uint64_t hash;
+        unsigned long long steps;
+    } checkpoint;
+    unsigned long long checkpoint_distance, checkpoint_power;
+    uint64_t tapes_hash;
+    std::vector<uint64_t> head_power; // R^head for every tape
+
+    bool execute_sweep(size_t slot, unsigned long long max_steps);
+    void move_head(int tape, long distance);
+    uint64_t configuration_hash() const;
+    void save_checkpoint();
+    void check_budgets_and_cycles();
+};
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef __TAPE_H
+#define __TAPE_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <vector>
+#include "compiled_machine.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// what happens when a head moves left from the first cell of the input:
+enum left_edge_t {
+    LEFT_EDGE_REJECT, // the machine rejects (the default, as in the original definition)
+    LEFT_EDGE_EXTEND, // the tape is extended to the left with blanks
+};
+
+// A tape of interned letters, unbounded in both directions.
+// Cells are addressed relative to the first cell of the input (cell 0);
+// the storage is one contiguous buffer that grows geometrically on the side
+// where it runs out of room, so that the cells are cheap and a sweep over
+// the tape is a linear scan of memory.
+class Tape {
+public:
+    explicit Tape(symbol_t blank_ = 0) : blank(blank_) {
+        assign(std::vector<symbol_t>());
+    }
+
+    // resets the tape to contain the word starting at the given cell (cell 0 by default);
+    // the used part of a tape always contains cell 0, so first_cell <= 0
+    void assign(const std::vector<symbol_t> &word, long first_cell = 0) {
+        assert(first_cell <= 0);
+        cells.assign(word.size() + 2 * INITIAL_MARGIN, blank);
+        origin = INITIAL_MARGIN - first_cell;
+        for (size_t a = 0; a < word.size(); ++a)
+            cells[INITIAL_MARGIN + a] = word[a];
+        first = first_cell;
+        last = first_cell + (long)word.size() - 1;
+        reach(0);
+    }
+
+    // makes the cell available for reading, extending the used part of the tape with blanks
+    void reach(long pos) {
+        if (pos < first) {
+            if ((long)origin + pos < 0)
+                grow_left(pos);
+            first = pos;
+        }
+        if (pos > last) {
+            if ((long)origin + pos >= (long)cells.size())
+                grow_right(pos);
+            last = pos;
+        }
+    }
+
+    // the cell has to be reached before
+    symbol_t get(long pos) const {
+        return cells[origin + pos];
+    }
+
+    // any cell, outside of the used part of the tape it is blank
+    symbol_t get_or_blank(long pos) const {
+        return pos < first || pos > last ? blank : cells[origin + pos];
+    }
+
+    void set(long pos, symbol_t letter) {
+        cells[origin + pos] = letter;
+    }
+
+    // the used part of the tape is [first_cell(), last_cell()]
+    long first_cell() const {
+        return first;
+    }
+
+    long last_cell() const {
+        return last;
+    }
+
+    unsigned long long used_cells() const {
+        return last - first + 1;
+    }
+
+    symbol_t blank_letter() const {
+        return blank;
+    }
+
+    // do the tapes differ only by the blank cells they used
+    bool same_contents(const Tape &other) const {
+        for (long pos = std::min(first, other.first); pos <= std::max(last, other.last); ++pos)
+            if (get_or_blank(pos) != other.get_or_blank(pos))
+                return false;
+        return true;
+    }
+
+    // returns the number of consecutive cells, starting from the cell at pos
+    // and going in the direction of the sweep, which continue the sweep;
+    // only the used part of the tape is scanned
+    long scan(long pos, const Sweep &sweep) const {
+        long end = sweep.move > 0 ? last + 1 : first - 1;
+        long from = pos;
+        if (pos < first || pos > last)
+            return 0;
+#ifdef __SSE2__
+        // compare eight cells at a time with every letter of a short sweep
+        if (sweep.members.size() <= MAX_VECTOR_MEMBERS) {
+            __m128i letters[MAX_VECTOR_MEMBERS];
+            size_t num_letters = sweep.members.size();
+            for (size_t a = 0; a < num_letters; ++a)
+                letters[a] = _mm_set1_epi16((short)sweep.members[a]);
+            for (;;) {
+                long block = sweep.move > 0 ? pos : pos - 7;
+                if (sweep.move > 0 ? end - pos < 8 : pos - end < 8)
+                    break;
+                __m128i v = _mm_loadu_si128((const __m128i *)&cells[origin + block]);
+                __m128i hit = _mm_setzero_si128();
+                for (size_t a = 0; a < num_letters; ++a)
+                    hit = _mm_or_si128(hit, _mm_cmpeq_epi16(v, letters[a]));
+                if (_mm_movemask_epi8(hit) != 0xFFFF)
+                    break;
+                pos += 8 * sweep.move;
+            }
+        }
+#endif
+        while (pos != end && sweep.member[cells[origin + pos]])
+            pos += sweep.move;
+        return (pos - from) * sweep.move;
+    }
+
+private:
+    static const size_t INITIAL_MARGIN = 16;
+    static const size_t MAX_VECTOR_MEMBERS = 8;
+
+    symbol_t blank;
+    std::vector<symbol_t> cells;
+    size_t origin; // index of cell 0 in cells
+    long first, last;
+
+    void grow_left(long pos) {
+        size_t extra = cells.size();
+        while ((long)(origin + extra) + pos < 0)
+            extra *= 2;
+        cells.insert(cells.begin(), extra, blank);
+        origin += extra;
+    }
+
+    void grow_right(long pos) {
+        size_t size = cells.size() * 2;
+        while ((long)origin + pos >= (long)size)
+            size *= 2;
+        cells.resize(size, blank);
+    }
+};
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef __THREAD_POOL_H
+#define __THREAD_POOL_H
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing parallel loop: calls task(worker, i) for every i in [0, num_tasks)
+// on num_threads workers (worker is in [0, num_threads)).
+// Every worker starts with a contiguous range of tasks and takes them from its front;
+// a worker whose range is empty steals the back half of the largest other range.
+static inline void parallel_for(size_t num_tasks, unsigned num_threads,
+                                const std::function<void(unsigned, size_t)> &task) {
+    if (num_threads == 0)
+        num_threads = 1;
+    if (num_threads > num_tasks)
+        num_threads = num_tasks ? (unsigned)num_tasks : 1;
+    if (num_threads == 1) {
+        for (size_t i = 0; i < num_tasks; ++i)
+            task(0, i);
+        return;
+    }
+
+    struct Range {
+        std::mutex mutex;
+        size_t begin, end;
+    };
+    std::vector<Range> ranges(num_threads);
+    for (unsigned w = 0; w < num_threads; ++w) {
+        ranges[w].begin = num_tasks * w / num_threads;
+        ranges[w].end = num_tasks * (w + 1) / num_threads;
+    }
+
+    auto worker = [&](unsigned w) {
+        for (;;) {
+            size_t i = 0;
+            bool found = false;
+            {
+                std::lock_guard<std::mutex> lock(ranges[w].mutex);
+                if (ranges[w].begin < ranges[w].end) {
+                    i = ranges[w].begin++;
+                    found = true;
+                }
+            }
+            if (found) {
+                task(w, i);
+                continue;
+            }
+
+            // steal from the victim with the most remaining tasks
+            unsigned victim = w;
+            size_t most = 0;
+            for (unsigned v = 0; v < num_threads; ++v) {
+                if (v == w)
+                    continue;
+                std::lock_guard<std::mutex> lock(ranges[v].mutex);
+                if (ranges[v].end - ranges[v].begin > most) {
+                    most = ranges[v].end - ranges[v].begin;
+                    victim = v;
+                }
+            }
+            if (victim == w)
+                return;
+            size_t begin, end;
+            {
+                std::lock_guard<std::mutex> lock(ranges[victim].mutex);
+                size_t left = ranges[victim].end - ranges[victim].begin;
+                if (left == 0)
+                    continue;
+                end = ranges[victim].end;
+                begin = end - (left + 1) / 2;
+                ranges[victim].end = begin;
+            }
+            std::lock_guard<std::mutex> lock(ranges[w].mutex);
+            ranges[w].begin = begin;
+            ranges[w].end = end;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned w = 1; w < num_threads; ++w)
+        threads.emplace_back(worker, w);
+    worker(0);
+    for (auto &thread : threads)
+        thread.join();
+}
+
+#endif
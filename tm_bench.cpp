@@ -0,0 +1,379 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iterator>
+#include <random>
+#include "turing_machine.h"
+#include "compiled_machine.h"
+#include "simulator.h"
+
+using namespace std;
+
+// Benchmarks of the reducer and the interpreter on palindromes.tm and on synthetic machines.
+// The results are written as JSON, so that two versions can be compared.
+
+static void print_usage(string error) {
+    cerr << "ERROR: " << error << "\n"
+         << "Usage: tm_bench [--output <file>] [--seed <n>] [--max-length <n>]\n"
+         << "       tm_bench --generate <file> [--tapes <k>] [--states <n>] [--letters <m>] [--density <d>]\n"
+         << "                          [--halting <p>] [--seed <n>]\n"
+         << "       tm_bench --palindrome <length> [--seed <n>]\n";
+    exit(1);
+}
+
+static const double MIN_SECONDS = 0.2; // every measurement is repeated until it takes this long
+static const unsigned long long RANDOM_RUN_STEPS = 100000; // step budget of a run of a synthetic machine
+static const size_t MAX_REDUCED_LENGTH = 10000; // runs of the reduced palindromes are quadratic
+
+// a deterministic random number generator, so that the workloads are the same in every version
+static mt19937_64 rng;
+
+static size_t random_below(size_t n) {
+    return rng() % n;
+}
+
+static double random_fraction() {
+    return (rng() >> 11) * 0x1.0p-53;
+}
+
+static string input_letter(size_t i) {
+    return i < 26 ? string(1, (char)('a' + i)) : "(a" + to_string(i) + ")";
+}
+
+static string working_letter(size_t i) {
+    return "(w" + to_string(i) + ")";
+}
+
+static string state_name(size_t i) {
+    return i == 0 ? INITIAL_STATE : "(q" + to_string(i) + ")";
+}
+
+// A random deterministic machine: every pair (state, letters under the heads) has a transition
+// with probability density, which goes to the accepting or the rejecting state with probability halting.
+// num_letters includes the blank; about half of the others are input letters.
+static TuringMachine generate_machine(int num_tapes, size_t num_states, size_t num_letters, double density, double halting) {
+    size_t num_input = max<size_t>(1, (num_letters - 1) / 2);
+    vector<string> input_alphabet, letters = {BLANK};
+    for (size_t a = 0; a < num_input; ++a)
+        input_alphabet.emplace_back(input_letter(a));
+    letters.insert(letters.end(), input_alphabet.begin(), input_alphabet.end());
+    for (size_t a = 0; letters.size() < num_letters; ++a)
+        letters.emplace_back(working_letter(a));
+
+    const char directions[] = {HEAD_LEFT, HEAD_STAY, HEAD_RIGHT};
+    transitions_t transitions;
+    size_t row_size = 1;
+    for (int a = 0; a < num_tapes; ++a)
+        row_size *= letters.size();
+    for (size_t state = 0; state < num_states; ++state) {
+        for (size_t row = 0; row < row_size; ++row) {
+            if (random_fraction() >= density)
+                continue;
+            vector<string> letters_before, letters_after;
+            string moves;
+            for (size_t rest = row, a = 0; a < (size_t)num_tapes; ++a, rest /= letters.size()) {
+                letters_before.emplace_back(letters[rest % letters.size()]);
+                letters_after.emplace_back(letters[random_below(letters.size())]);
+                moves += directions[random_below(3)];
+            }
+            string next_state = state_name(random_below(num_states));
+            if (random_fraction() < halting)
+                next_state = random_below(2) ? ACCEPTING_STATE : REJECTING_STATE;
+            transitions[make_pair(state_name(state), letters_before)] = make_tuple(next_state, letters_after, moves);
+        }
+    }
+    return TuringMachine(num_tapes, input_alphabet, transitions);
+}
+
+static vector<string> random_word(const vector<string> &alphabet, size_t length) {
+    vector<string> res;
+    for (size_t a = 0; a < length; ++a)
+        res.emplace_back(alphabet[random_below(alphabet.size())]);
+    return res;
+}
+
+static string palindrome(size_t length) {
+    string res;
+    for (size_t a = 0; a < length / 2; ++a)
+        res += random_below(2) ? 'a' : 'b';
+    string half = res;
+    if (length % 2)
+        res += random_below(2) ? 'a' : 'b';
+    return res + string(half.rbegin(), half.rend());
+}
+
+static double now() {
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// the mean time of a call, repeated until the calls take at least MIN_SECONDS together
+static double seconds_per_call(const function<void()> &call) {
+    double start = now(), elapsed;
+    unsigned long long calls = 0;
+    do {
+        call();
+        ++calls;
+        elapsed = now() - start;
+    } while (elapsed < MIN_SECONDS);
+    return elapsed / calls;
+}
+
+static TuringMachine parse_machine(const string &text) {
+    FILE *f = fmemopen((void *)text.data(), text.size(), "r");
+    if (!f) {
+        cerr << "ERROR: Cannot read a machine from memory\n";
+        exit(1);
+    }
+    return read_tm_from_file(f);
+}
+
+static string machine_text(const TuringMachine &tm) {
+    ostringstream output;
+    tm.save_to_file(output);
+    return output.str();
+}
+
+// the JSON output, one object per line
+class Results {
+public:
+    explicit Results(const string &filename) : output(filename) {
+        if (!output) {
+            cerr << "ERROR: Cannot write to file " << filename << "\n";
+            exit(1);
+        }
+        output << "{\n";
+    }
+
+    ~Results() {
+        close_section();
+        output << "\n}\n";
+    }
+
+    void section(const string &name) {
+        close_section();
+        output << (sections++ ? ",\n" : "") << "  \"" << name << "\": [\n";
+        items = 0;
+    }
+
+    Results &item() {
+        output << (items++ ? "},\n" : "") << "    {";
+        fields = 0;
+        return *this;
+    }
+
+    template<class T>
+    Results &field(const string &name, const T &value) {
+        output << (fields++ ? ", " : "") << "\"" << name << "\": " << value;
+        return *this;
+    }
+
+    Results &field(const string &name, const string &value) {
+        output << (fields++ ? ", " : "") << "\"" << name << "\": \"" << value << "\"";
+        return *this;
+    }
+
+private:
+    ofstream output;
+    int sections = 0, items = 0, fields = 0;
+
+    void close_section() {
+        if (sections)
+            output << (items ? "}\n" : "") << "  ]";
+    }
+};
+
+static void bench_machine(Results &results, const string &name, const string &text) {
+    TuringMachine tm = parse_machine(text);
+    results.item().field("machine", name).field("tapes", tm.num_tapes)
+        .field("states", tm.set_of_states().size()).field("letters", tm.working_alphabet().size())
+        .field("transitions", tm.transitions.size())
+        .field("read_ms", 1000 * seconds_per_call([&]() { parse_machine(text); }))
+        .field("save_ms", 1000 * seconds_per_call([&]() { machine_text(tm); }))
+        .field("compile_ms", 1000 * seconds_per_call([&]() { CompiledMachine cm(tm); }));
+    if (tm.num_tapes == 2) {
+        TuringMachine reduced = tm.reduce_two_tapes_to_one();
+        results.field("reduce_ms", 1000 * seconds_per_call([&]() { tm.reduce_two_tapes_to_one(); }))
+            .field("reduced_transitions", reduced.transitions.size())
+            .field("reduced_save_ms", 1000 * seconds_per_call([&]() { machine_text(reduced); }));
+    }
+    cerr << "machine " << name << " done\n";
+}
+
+// runs the machine on all words, repeated until it takes at least MIN_SECONDS; returns the number of steps;
+// for a reduced machine, the steps of the original one give the steps per simulated step
+static unsigned long long bench_runs(Results &results, const string &name, const CompiledMachine &cm,
+                                     const vector<vector<string>> &words, unsigned long long max_steps,
+                                     unsigned long long original_steps = 0) {
+    vector<vector<symbol_t>> encoded;
+    size_t length = 0;
+    for (const auto &word : words) {
+        encoded.emplace_back(cm.encode(word));
+        length = max(length, word.size());
+    }
+    Simulator sim(cm);
+    sim.left_edge = LEFT_EDGE_EXTEND; // random machines would mostly fall off the tape
+    unsigned long long steps = 0;
+    double seconds = seconds_per_call([&]() {
+        steps = 0;
+        for (const auto &word : encoded) {
+            sim.start(word);
+            sim.run(max_steps);
+            steps += sim.steps;
+        }
+    });
+    results.item().field("machine", name).field("words", words.size()).field("length", length)
+        .field("steps", steps).field("seconds", seconds).field("steps_per_second", steps / seconds);
+    if (original_steps)
+        results.field("steps_per_simulated_step", (double)steps / original_steps);
+    cerr << "run " << name << " " << length << " done\n";
+    return steps;
+}
+
+struct Synthetic {
+    int tapes;
+    size_t states, letters;
+    double density, halting;
+};
+
+static const Synthetic SYNTHETIC[] = {
+    {2, 10, 4, 0.8, 0.1},
+    {2, 100, 6, 0.5, 0.1},
+    {2, 1000, 4, 0.3, 0.1},
+    {3, 100, 4, 0.5, 0.1},
+    {1, 1000, 8, 0.5, 0.1},
+    // dense machines which rarely halt, for the speed of the interpreter
+    {2, 100, 4, 1, 0.0001},
+    {3, 1000, 6, 1, 0.0001},
+};
+
+static string synthetic_name(const Synthetic &s) {
+    ostringstream name;
+    name << "random-" << s.tapes << "t-" << s.states << "s-" << s.letters << "l-" << s.density << "d-" << s.halting << "h";
+    return name.str();
+}
+
+static void run_benchmarks(const string &output, size_t max_length) {
+    ifstream file("palindromes.tm");
+    if (!file) {
+        cerr << "ERROR: File palindromes.tm does not exist\n";
+        exit(1);
+    }
+    string palindromes_text((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    vector<string> synthetic_texts;
+    for (const auto &s : SYNTHETIC)
+        synthetic_texts.emplace_back(machine_text(generate_machine(s.tapes, s.states, s.letters, s.density, s.halting)));
+
+    Results results(output);
+    results.section("machines");
+    bench_machine(results, "palindromes", palindromes_text);
+    for (size_t a = 0; a < synthetic_texts.size(); ++a)
+        bench_machine(results, synthetic_name(SYNTHETIC[a]), synthetic_texts[a]);
+
+    results.section("runs");
+    TuringMachine palindromes = parse_machine(palindromes_text);
+    TuringMachine reduced = palindromes.reduce_two_tapes_to_one();
+    TuringMachine reduced_tracks = palindromes.reduce_two_tapes_to_one(REDUCTION_TRACKS);
+    TuringMachine reduced_boustrophedon = palindromes.reduce_two_tapes_to_one(REDUCTION_BOUSTROPHEDON);
+    CompiledMachine palindromes_cm(palindromes), reduced_cm(reduced), reduced_tracks_cm(reduced_tracks),
+        reduced_boustrophedon_cm(reduced_boustrophedon);
+    for (size_t length = 10; length <= max_length; length *= 10) {
+        vector<vector<string>> words = {palindromes.parse_input(palindrome(length))};
+        unsigned long long steps = bench_runs(results, "palindromes", palindromes_cm, words, 0);
+        if (length <= MAX_REDUCED_LENGTH) {
+            bench_runs(results, "palindromes-reduced", reduced_cm, words, 0, steps);
+            bench_runs(results, "palindromes-reduced-tracks", reduced_tracks_cm, words, 0, steps);
+            bench_runs(results, "palindromes-reduced-boustrophedon", reduced_boustrophedon_cm, words, 0, steps);
+        }
+    }
+    for (size_t a = 0; a < synthetic_texts.size(); ++a) {
+        TuringMachine tm = parse_machine(synthetic_texts[a]);
+        CompiledMachine cm(tm);
+        vector<vector<string>> words;
+        for (int b = 0; b < 100; ++b)
+            words.emplace_back(random_word(tm.input_alphabet, 100));
+        bench_runs(results, synthetic_name(SYNTHETIC[a]), cm, words, RANDOM_RUN_STEPS);
+    }
+}
+
+static unsigned long long read_number(const string &name, const string &value) {
+    try {
+        size_t last;
+        unsigned long long res = stoull(value, &last);
+        if (last == value.length() && value[0] != '-')
+            return res;
+    } catch (...) {
+    }
+    print_usage("Nonnegative integer expected as the value of " + name);
+    return 0;
+}
+
+static double read_fraction(const string &name, const string &value) {
+    try {
+        size_t last;
+        double res = stod(value, &last);
+        if (last == value.length() && res >= 0 && res <= 1)
+            return res;
+    } catch (...) {
+    }
+    print_usage("Number from [0, 1] expected as the value of " + name);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    string output = "bench_results.json", generate;
+    size_t max_length = 100000, palindrome_length = 0;
+    bool print_palindrome = false;
+    Synthetic s = {2, 10, 4, 0.5, 0.1};
+    uint64_t seed = 1;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (i + 1 >= argc)
+            print_usage("Missing value of " + arg);
+        string value = argv[++i];
+        if (arg == "--output")
+            output = value;
+        else if (arg == "--seed")
+            seed = read_number(arg, value);
+        else if (arg == "--max-length")
+            max_length = read_number(arg, value);
+        else if (arg == "--generate")
+            generate = value;
+        else if (arg == "--tapes")
+            s.tapes = (int)read_number(arg, value);
+        else if (arg == "--states")
+            s.states = read_number(arg, value);
+        else if (arg == "--letters")
+            s.letters = read_number(arg, value);
+        else if (arg == "--density")
+            s.density = read_fraction(arg, value);
+        else if (arg == "--halting")
+            s.halting = read_fraction(arg, value);
+        else if (arg == "--palindrome") {
+            print_palindrome = true;
+            palindrome_length = read_number(arg, value);
+        } else
+            print_usage("Unknown option " + arg);
+    }
+    rng.seed(seed);
+
+    if (print_palindrome) {
+        cout << palindrome(palindrome_length) << "\n";
+        return 0;
+    }
+    if (!generate.empty()) {
+        if (s.tapes <= 0 || s.states == 0 || s.letters < 2)
+            print_usage("A machine needs a tape, a state and two letters");
+        ofstream file(generate);
+        if (!file) {
+            cerr << "ERROR: Cannot write to file " << generate << "\n";
+            return 1;
+        }
+        generate_machine(s.tapes, s.states, s.letters, s.density, s.halting).save_to_file(file);
+        return 0;
+    }
+    run_benchmarks(output, max_length);
+}
@@ -0,0 +1,280 @@
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include "turing_machine.h"
+#include "compiled_machine.h"
+
+using namespace std;
+
+// Translates a machine into a standalone C++ program:
+// every state becomes a label with a switch on the letters under the heads,
+// and every transition jumps straight to the label of the next state.
+
+static void print_usage(string error) {
+    cerr << "ERROR: " << error << "\n"
+         << "Usage: tm_compile [--cpp-only] <input_file> <output>\n"
+         << "  writes <output>.cpp and builds it into <output> with $CXX (g++ by default);\n"
+         << "  with --cpp-only the C++ program is written to <output> and not built\n";
+    exit(1);
+}
+
+static const char *PROGRAM_HEADER = R"(#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+typedef uint16_t symbol_t;
+
+static bool verbose = true;
+static bool print_steps = false;
+static unsigned long long steps = 0;
+
+static void print_usage(const char *error) {
+    fprintf(stderr, "ERROR: %s\nUsage: %s [-q|--quiet] [-s|--steps] <input>\n", error, PROGRAM_NAME);
+    exit(1);
+}
+
+static int halt(bool accept) {
+    if (print_steps)
+        printf("%s %llu\n", accept ? "ACCEPT" : "REJECT", steps);
+    else
+        printf("%s\n", accept ? "ACCEPT" : "REJECT");
+    return 0;
+}
+
+static int no_transition() {
+    if (verbose)
+        fprintf(stderr, "No transition from this configuration\n");
+    return halt(false);
+}
+
+static int falls_off(int tape) {
+    if (verbose)
+        fprintf(stderr, "Head %d falls off the tape in the next transition\n", tape);
+    return halt(false);
+}
+
+static bool is_valid_char(char ch) {
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '_' || ch == '-';
+}
+
+// the length of the identifier at the beginning of s, 0 if there is none
+static size_t identifier_length(const char *s) {
+    if (is_valid_char(s[0]))
+        return 1;
+    if (s[0] != '(')
+        return 0;
+    size_t pos = 1;
+    int depth = 1;
+    while (depth > 0) {
+        if (s[pos] == '(')
+            ++depth;
+        else if (s[pos] == ')') {
+            if (s[pos - 1] == '(')
+                return 0;
+            --depth;
+        } else if (!is_valid_char(s[pos]))
+            return 0;
+        ++pos;
+    }
+    return pos;
+}
+
+static void grow(vector<symbol_t> &tape) {
+    tape.resize(tape.size() * 2, BLANK);
+}
+
+int main(int argc, char *argv[]) {
+    const char *input = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-q") || !strcmp(argv[i], "--quiet"))
+            verbose = false;
+        else if (!strcmp(argv[i], "-s") || !strcmp(argv[i], "--steps"))
+            print_steps = true;
+        else if (input)
+            print_usage("Too many arguments");
+        else
+            input = argv[i];
+    }
+    if (!input)
+        print_usage("Not enough arguments");
+
+    vector<symbol_t> word;
+    for (const char *s = input; *s;) {
+        size_t length = identifier_length(s);
+        int letter = -1;
+        for (size_t a = 0; length && a < NUM_INPUT_LETTERS; ++a)
+            if (strlen(INPUT_LETTERS[a]) == length && !strncmp(INPUT_LETTERS[a], s, length))
+                letter = INPUT_IDS[a];
+        if (letter == -1) {
+            fprintf(stderr, "ERROR: The last argument is not a sequence of input letters\n");
+            return 1;
+        }
+        word.push_back((symbol_t)letter);
+        s += length;
+    }
+
+)";
+
+static string tape(int a) {
+    return "t" + to_string(a);
+}
+
+static string head(int a) {
+    return "h" + to_string(a);
+}
+
+static string label(state_t state) {
+    return "S" + to_string(state);
+}
+
+// the text escaped for a C string literal
+static string escape(const string &text) {
+    string res;
+    for (unsigned char c : text) {
+        if (c == '\\' || c == '"')
+            res += string("\\") + (char)c;
+        else if (c < 0x20 || c >= 0x7F) {
+            // three octal digits, so that a following digit is not taken into the escape
+            char octal[5];
+            snprintf(octal, sizeof(octal), "\\%03o", c);
+            res += octal;
+        } else
+            res += (char)c;
+    }
+    return res;
+}
+
+// the text as a single word of a command of the shell
+static string shell_quote(const string &text) {
+    string res = "'";
+    for (char c : text)
+        res += c == '\'' ? string("'\\''") : string(1, c);
+    return res + "'";
+}
+
+static void write_program(ostream &out, const CompiledMachine &cm, const TuringMachine &tm, const string &name) {
+    out << "// generated by tm_compile from \"" << escape(name) << "\"\n"
+        << "#define PROGRAM_NAME \"" << escape(name) << "\"\n"
+        << "#define BLANK " << cm.blank << "\n"
+        << "#define NUM_INPUT_LETTERS " << tm.input_alphabet.size() << "\n"
+        << "static const char *INPUT_LETTERS[] = {";
+    for (const auto &letter : tm.input_alphabet)
+        out << "\"" << escape(letter) << "\", ";
+    out << "};\nstatic const int INPUT_IDS[] = {";
+    for (const auto &letter : tm.input_alphabet)
+        out << cm.letter_ids.at(letter) << ", ";
+    out << "};\n\n" << PROGRAM_HEADER;
+
+    for (int a = 0; a < cm.num_tapes; ++a) {
+        out << "    vector<symbol_t> " << tape(a) << (a == 0 ? "(word)" : "") << ";\n"
+            << "    " << tape(a) << ".resize(" << tape(a) << ".size() + 16, BLANK);\n"
+            << "    size_t " << head(a) << " = 0;\n";
+    }
+    out << "    goto " << label(cm.initial_state) << ";\n\n";
+
+    size_t num_letters = cm.letters.size();
+    vector<symbol_t> letters(cm.num_tapes);
+    // the transitions of every state, in the order of their rows
+    vector<vector<size_t>> state_slots(cm.states.size());
+    for (size_t slot = 0; slot < cm.num_slots; ++slot)
+        if (cm.entry_at(slot)[0] != NO_TRANSITION)
+            state_slots[cm.index_of_slot(slot) / cm.row_size].push_back(slot);
+    for (state_t state = 0; state < cm.states.size(); ++state) {
+        out << label(state) << ": // " << cm.states[state] << "\n";
+        if (state == cm.accepting_state) {
+            out << "    return halt(true);\n";
+            continue;
+        }
+        if (state == cm.rejecting_state) {
+            out << "    return halt(false);\n";
+            continue;
+        }
+        // the same index as in CompiledMachine::index
+        string key = tape(cm.num_tapes - 1) + "[" + head(cm.num_tapes - 1) + "]";
+        for (int a = cm.num_tapes - 2; a >= 0; --a)
+            key = "(" + key + ") * " + to_string(num_letters) + " + " + tape(a) + "[" + head(a) + "]";
+        out << "    switch (" << key << ") {\n";
+        sort(state_slots[state].begin(), state_slots[state].end(), [&](size_t a, size_t b) {
+            return cm.index_of_slot(a) < cm.index_of_slot(b);
+        });
+        for (size_t slot : state_slots[state]) {
+            const uint32_t *e = cm.entry_at(slot);
+            size_t row = cm.index_of_slot(slot) % cm.row_size;
+            out << "    case " << row << ":";
+            size_t rest = row;
+            for (int a = 0; a < cm.num_tapes; ++a) {
+                letters[a] = (symbol_t)(rest % num_letters);
+                rest /= num_letters;
+            }
+            for (int a = 0; a < cm.num_tapes; ++a) {
+                if (action_letter(e[1 + a]) != letters[a])
+                    out << " " << tape(a) << "[" << head(a) << "] = " << action_letter(e[1 + a]) << ";";
+                int move = action_move(e[1 + a]);
+                if (move < 0)
+                    out << " if (!" << head(a) << ") return falls_off(" << a + 1 << "); --" << head(a) << ";";
+                if (move > 0)
+                    out << " if (++" << head(a) << " == " << tape(a) << ".size()) grow(" << tape(a) << ");";
+            }
+            out << " ++steps; goto " << label(e[0]) << ";\n";
+        }
+        out << "    default: return no_transition();\n"
+            << "    }\n";
+    }
+    out << "}\n";
+}
+
+int main(int argc, char *argv[]) {
+    bool cpp_only = false;
+    vector<string> args;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--cpp-only")
+            cpp_only = true;
+        else
+            args.emplace_back(arg);
+    }
+    if (args.size() < 2)
+        print_usage("Not enough arguments");
+    if (args.size() > 2)
+        print_usage("Too many arguments");
+
+    FILE *f = fopen(args[0].c_str(), "r");
+    if (!f) {
+        cerr << "ERROR: File " << args[0] << " does not exist\n";
+        return 1;
+    }
+    TuringMachine tm = read_tm_from_file(f);
+    CompiledMachine cm(tm);
+
+    string source = cpp_only ? args[1] : args[1] + ".cpp";
+    {
+        ofstream out(source);
+        if (!out) {
+            cerr << "ERROR: Cannot write to file " << source << "\n";
+            return 1;
+        }
+        string name = args[1].substr(args[1].find_last_of('/') + 1);
+        write_program(out, cm, tm, name);
+    }
+    if (cpp_only)
+        return 0;
+
+    // $CXX may hold options, so it is left to the shell, while the paths are quoted;
+    // a path starting with - would be taken for an option
+    auto path = [](const string &filename) {
+        return shell_quote(filename[0] == '-' ? "./" + filename : filename);
+    };
+    const char *cxx = getenv("CXX");
+    string command = string(cxx ? cxx : "g++") + " -O2 -o " + path(args[1]) + " " + path(source);
+    if (system(command.c_str()) != 0) {
+        cerr << "ERROR: Building the program failed: " << command << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,252 @@
+#include <iostream>
+#include <sstream>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include "turing_machine.h"
+#include "compiled_machine.h"
+#include "simulator.h"
+#include "thread_pool.h"
+#include "words.h"
+
+using namespace std;
+
+// Measures how the running time and the space of machines grow with the length of the input:
+// every machine runs on the same words (all words up to a length, or a random sample of a length
+// which has too many of them), and the worst and the mean steps and cells per length are fitted
+// with the models c * n^k and c * b^n. The steps of every further machine are also fitted as
+// c * T^k, where T are the steps of the first one, so a machine and its reduction give the overhead.
+
+static void print_usage(string error) {
+    cerr << "ERROR: " << error << "\n"
+         << "Usage: tm_complexity [--max-length <n>] [--words <n>] [--max-steps <n>] [--fit-from <n>] [--seed <n>]\n"
+         << "                     [--reduce] [-j|--threads <n>] <TM definition> [<TM definition>...]\n";
+    exit(1);
+}
+
+struct Machine {
+    string name;
+    unique_ptr<CompiledMachine> cm;
+};
+
+// the runs of a machine on the words of a single length
+struct LengthStats {
+    unsigned long long words = 0, limited = 0;
+    unsigned long long max_steps = 0, max_cells = 0;
+    double sum_steps = 0, sum_cells = 0;
+
+    void add(const LengthStats &other) {
+        words += other.words;
+        limited += other.limited;
+        max_steps = max(max_steps, other.max_steps);
+        max_cells = max(max_cells, other.max_cells);
+        sum_steps += other.sum_steps;
+        sum_cells += other.sum_cells;
+    }
+};
+
+// the least squares line y = a + b * x; returns false if there are fewer than two distinct x
+static bool fit_line(const vector<double> &x, const vector<double> &y, double &a, double &b, double &r2) {
+    size_t n = x.size();
+    double mean_x = 0, mean_y = 0;
+    for (size_t i = 0; i < n; ++i) {
+        mean_x += x[i] / n;
+        mean_y += y[i] / n;
+    }
+    double sxx = 0, sxy = 0, syy = 0;
+    for (size_t i = 0; i < n; ++i) {
+        sxx += (x[i] - mean_x) * (x[i] - mean_x);
+        sxy += (x[i] - mean_x) * (y[i] - mean_y);
+        syy += (y[i] - mean_y) * (y[i] - mean_y);
+    }
+    if (n < 2 || sxx == 0)
+        return false;
+    b = sxy / sxx;
+    a = mean_y - b * mean_x;
+    r2 = syy == 0 ? 1 : sxy * sxy / (sxx * syy);
+    return true;
+}
+
+static string number(double value) {
+    ostringstream res;
+    res.precision(4);
+    res << value;
+    return res.str();
+}
+
+// fits the values of the lengths with c * n^k and c * b^n (in the logarithms) and prints both, the better one first
+static void print_fits(const string &title, const vector<double> &lengths, const vector<double> &values) {
+    vector<double> log_lengths, log_values, linear_lengths;
+    for (size_t i = 0; i < lengths.size(); ++i) {
+        if (lengths[i] < 1 || values[i] <= 0)
+            continue;
+        log_lengths.push_back(log(lengths[i]));
+        linear_lengths.push_back(lengths[i]);
+        log_values.push_back(log(values[i]));
+    }
+    double a_poly, k, r2_poly, a_exp, log_base, r2_exp;
+    if (!fit_line(log_lengths, log_values, a_poly, k, r2_poly)
+            || !fit_line(linear_lengths, log_values, a_exp, log_base, r2_exp)) {
+        cout << title << ": too few lengths to fit\n";
+        return;
+    }
+    string poly = number(exp(a_poly)) + " * n^" + number(k) + " (r2 " + number(r2_poly) + ")";
+    string expo = number(exp(a_exp)) + " * " + number(exp(log_base)) + "^n (r2 " + number(r2_exp) + ")";
+    cout << title << ": " << (r2_poly >= r2_exp ? poly + ", " + expo : expo + ", " + poly) << "\n";
+}
+
+// fits the values of a machine as c * T^k of the values T of the first machine
+static void print_overhead(const string &title, const vector<double> &base, const vector<double> &values) {
+    vector<double> x, y;
+    for (size_t i = 0; i < base.size(); ++i) {
+        if (base[i] <= 0 || values[i] <= 0)
+            continue;
+        x.push_back(log(base[i]));
+        y.push_back(log(values[i]));
+    }
+    double a, k, r2;
+    if (!fit_line(x, y, a, k, r2)) {
+        cout << title << ": too few lengths to fit\n";
+        return;
+    }
+    cout << title << ": " << number(exp(a)) << " * T^" << number(k) << " (r2 " << number(r2) << ")\n";
+}
+
+static unsigned long long read_number(const string &name, const string &value) {
+    try {
+        size_t last;
+        unsigned long long res = stoull(value, &last);
+        if (last == value.length() && value[0] != '-')
+            return res;
+    } catch (...) {
+    }
+    print_usage("Nonnegative integer expected as the value of " + name);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    size_t max_length = 10, num_words = 1000, fit_from = 0;
+    bool fit_from_set = false, reduce = false;
+    unsigned long long max_steps = 100000000;
+    unsigned num_threads = 0;
+    uint64_t seed = 1;
+    vector<string> filenames;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg.empty() || arg[0] != '-') {
+            filenames.push_back(arg);
+            continue;
+        }
+        if (arg == "--reduce") {
+            reduce = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+            print_usage("Missing value of " + arg);
+        string value = argv[++i];
+        if (arg == "--max-length")
+            max_length = read_number(arg, value);
+        else if (arg == "--words")
+            num_words = read_number(arg, value);
+        else if (arg == "--max-steps")
+            max_steps = read_number(arg, value);
+        else if (arg == "--fit-from") {
+            fit_from = read_number(arg, value);
+            fit_from_set = true;
+        } else if (arg == "--seed")
+            seed = read_number(arg, value);
+        else if (arg == "-j" || arg == "--threads")
+            num_threads = (unsigned)read_number(arg, value);
+        else
+            print_usage("Unknown option " + arg);
+    }
+    if (filenames.empty())
+        print_usage("Not enough arguments");
+    if (num_words == 0)
+        print_usage("At least one word of every length is needed");
+    if (num_threads == 0)
+        num_threads = max(1u, thread::hardware_concurrency());
+    // the lower-order terms distort the fits at the short lengths
+    if (!fit_from_set)
+        fit_from = max<size_t>(1, max_length / 2);
+
+    vector<Machine> machines;
+    vector<string> input_alphabet;
+    for (const auto &filename : filenames) {
+        FILE *f = fopen(filename.c_str(), "r");
+        if (!f) {
+            cerr << "ERROR: File " << filename << " does not exist\n";
+            return 1;
+        }
+        TuringMachine tm = read_tm_from_file(f);
+        if (machines.empty())
+            input_alphabet = tm.input_alphabet;
+        else if (tm.input_alphabet != input_alphabet) {
+            cerr << "ERROR: The machines have different input alphabets\n";
+            return 1;
+        }
+        machines.push_back({filename, unique_ptr<CompiledMachine>(new CompiledMachine(tm))});
+        if (reduce && tm.num_tapes == 2)
+            machines.push_back({filename + " (reduced)", unique_ptr<CompiledMachine>(
+                new CompiledMachine(tm.reduce_two_tapes_to_one(REDUCTION_PER_TRANSITION, num_threads)))});
+    }
+    if (input_alphabet.empty()) {
+        cerr << "ERROR: The machine has no input letters\n";
+        return 1;
+    }
+
+    vector<vector<string>> words = make_words(input_alphabet, max_length, num_words, seed);
+    vector<vector<double>> worst_steps(machines.size());
+    for (size_t m = 0; m < machines.size(); ++m) {
+        const CompiledMachine &cm = *machines[m].cm;
+        vector<Simulator> sims(num_threads, Simulator(cm));
+        vector<vector<LengthStats>> stats(num_threads, vector<LengthStats>(max_length + 1));
+        parallel_for(words.size(), num_threads, [&](unsigned worker, size_t i) {
+            Simulator &sim = sims[worker];
+            sim.start(cm.encode(words[i]));
+            sim.run(max_steps);
+            unsigned long long cells = 0;
+            for (const auto &tape : sim.tapes)
+                cells += tape.used_cells();
+            LengthStats &length_stats = stats[worker][words[i].size()];
+            ++length_stats.words;
+            length_stats.limited += sim.status == STATUS_LIMIT;
+            length_stats.max_steps = max(length_stats.max_steps, sim.steps);
+            length_stats.max_cells = max(length_stats.max_cells, cells);
+            length_stats.sum_steps += sim.steps;
+            length_stats.sum_cells += cells;
+        });
+
+        cout << "Machine " << machines[m].name << "\n"
+             << "length  words  limited  max_steps  mean_steps  max_cells  mean_cells\n";
+        // the lengths with a run stopped at the step limit are left out of the fits
+        vector<double> lengths, max_steps_fit, mean_steps_fit, max_cells_fit, mean_cells_fit;
+        worst_steps[m].assign(max_length + 1, 0);
+        for (size_t length = 0; length <= max_length; ++length) {
+            LengthStats total;
+            for (const auto &worker_stats : stats)
+                total.add(worker_stats[length]);
+            cout << length << "  " << total.words << "  " << total.limited << "  " << total.max_steps << "  "
+                 << total.sum_steps / total.words << "  " << total.max_cells << "  "
+                 << total.sum_cells / total.words << "\n";
+            if (length < fit_from || total.limited)
+                continue;
+            lengths.push_back(length);
+            max_steps_fit.push_back(total.max_steps);
+            mean_steps_fit.push_back(total.sum_steps / total.words);
+            max_cells_fit.push_back(total.max_cells);
+            mean_cells_fit.push_back(total.sum_cells / total.words);
+            worst_steps[m][length] = total.max_steps;
+        }
+        print_fits("Worst steps", lengths, max_steps_fit);
+        print_fits("Mean steps", lengths, mean_steps_fit);
+        print_fits("Worst cells", lengths, max_cells_fit);
+        print_fits("Mean cells", lengths, mean_cells_fit);
+        if (m)
+            print_overhead("Worst steps over those of " + machines[0].name + " (T)", worst_steps[0], worst_steps[m]);
+        cout << "\n";
+    }
+    return 0;
+}
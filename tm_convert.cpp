@@ -0,0 +1,37 @@
+#include <fstream>
+#include <iostream>
+#include "compiled_machine.h"
+#include "turing_machine.h"
+
+using namespace std;
+
+// Converts a machine between the text format and the binary one (.tmb),
+// which is told by the name of the output file.
+
+static void print_usage(string error) {
+    cerr << "ERROR: " << error << "\n"
+         << "Usage: tm_convert <input_file> <output_file>\n"
+         << "  the output is written in the binary format if its name ends with " BINARY_MACHINE_EXTENSION
+            ", and in the text one otherwise\n";
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3)
+        print_usage(argc < 3 ? "Not enough arguments" : "Too many arguments");
+    string output_filename = argv[2];
+    auto cm = read_compiled_machine(argv[1]);
+
+    if (has_binary_extension(output_filename)) {
+        if (!cm->save_binary(output_filename)) {
+            cerr << "ERROR: Cannot write to file " << output_filename << "\n";
+            return 1;
+        }
+        return 0;
+    }
+    ofstream output(output_filename);
+    if (!output || !(output << cm->to_turing_machine()) || !output.flush()) {
+        cerr << "ERROR: Cannot write to file " << output_filename << "\n";
+        return 1;
+    }
+}
@@ -1,129 +1,343 @@
 #include <iostream>
+#include <fstream>
 #include <sstream>
 #include <cstddef>
 #include <cstdlib>
+#include <memory>
+#include <thread>
 #include "turing_machine.h"
+#include "compiled_machine.h"
+#include "simulator.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include "profile.h"
+#include "checkpoint.h"
+#include "lazy_machine.h"
 
 using namespace std;
 
 static bool verbose = true;
+static left_edge_t left_edge = LEFT_EDGE_REJECT;
+static bool print_steps = false;
+static bool use_sweeps = true;
+static unsigned long long max_steps = 0;
+static unsigned long long max_cells = 0;
+static bool detect_cycles = false;
+static string batch_file;
+static unsigned num_threads = 0;
+static string trace_file;
+static unsigned long long trace_snapshots = 100000;
+static bool profile = false;
+static string profile_json;
+static string checkpoint_file;
+static unsigned long long checkpoint_snapshots = 100000000;
+static bool resume = false;
+static bool seek = false;
+static unsigned long long seek_step = 0;
+static bool reduce = false;
+static LazyMachine *lazy = nullptr;
 
 static void print_usage(string error) {
     cerr << "ERROR: " << error << "\n"
-         << "Usage: tm_interpreter [-q|--quiet] <input_file> <input>\n";
+         << "Usage: tm_interpreter [-q|--quiet] [-s|--steps] [--no-sweeps] [--left-edge=reject|extend]\n"
+         << "                      [--max-steps <n>] [--max-cells <n>] [--detect-cycles] [--reduce]\n"
+         << "                      [--trace <file> [--trace-snapshots <n>]] [--profile] [--profile-json <file>]\n"
+         << "                      [--checkpoint <file> [--checkpoint-snapshots <n>]] <input_file> <input>\n"
+         << "       tm_interpreter --checkpoint <file> --resume [options] <input_file>\n"
+         << "       tm_interpreter [--checkpoint <file>] --seek <step> <input_file> [<input>]\n"
+         << "       tm_interpreter --batch <file|-> [-j|--threads <n>] [options] <input_file>\n";
     exit(1);
 }
 
-void halt(bool accept) {
-    cout << (accept ? "ACCEPT" : "REJECT") << "\n";
-    exit(0);
+static const char *result_name(status_t status) {
+    switch (status) {
+    case STATUS_ACCEPT:
+        return "ACCEPT";
+    case STATUS_LIMIT:
+        return "LIMIT";
+    case STATUS_LOOP:
+        return "LOOP";
+    default:
+        return "REJECT";
+    }
 }
 
-vector<vector<string>> tapes;
-vector<size_t> heads;
-string state = INITIAL_STATE;
+static string cycle_info(const Simulator &sim) {
+    return sim.status == STATUS_LOOP ? " cycle=" + to_string(sim.cycle_length) : "";
+}
 
-void append_blanks_under_heads() {
-    for (size_t a = 0; a < tapes.size(); ++a)
-        if (heads[a] >= tapes[a].size())
-            tapes[a].emplace_back(BLANK);
+static void configure(Simulator &sim) {
+    sim.use_sweeps = use_sweeps;
+    sim.left_edge = left_edge;
+    sim.max_cells = max_cells;
+    sim.detect_cycles = detect_cycles;
+    sim.lazy = lazy;
 }
 
-void execute_step(const TuringMachine &tm) {
-    pair<string, vector<string>> cur;
-    cur.first = state;
-    for (size_t a = 0; a < tapes.size(); ++a)
-        cur.second.emplace_back(tapes[a][heads[a]]);
-    if (tm.transitions.find(cur) == tm.transitions.end()) {
-        if (verbose)
+int halt(const Simulator &sim) {
+    if (verbose) {
+        if (sim.status == STATUS_NO_TRANSITION)
             cerr << "No transition from this configuration\n";
-        halt(false);
-    }
-    auto trans = tm.transitions.at(cur);
-    state = get<0>(trans);
-    for (size_t a = 0; a < tapes.size(); ++a) {
-        tapes[a][heads[a]] = get<1>(trans)[a];
-        char dir = get<2>(trans)[a];
-        if (dir == HEAD_LEFT && !heads[a]) {
-            if (verbose)
-                cerr << "Head " << a + 1 << " falls off the tape in the next transition\n";
-            halt(false);
-        }
-        heads[a] += dir == HEAD_LEFT ? -1 : dir == HEAD_RIGHT ? 1 : 0;
+        if (sim.status == STATUS_FELL_OFF)
+            cerr << "Head " << sim.fallen_tape + 1 << " falls off the tape in the next transition\n";
     }
-    append_blanks_under_heads();
+    cout << result_name(sim.status);
+    if (print_steps)
+        cout << " " << sim.steps;
+    cout << cycle_info(sim) << "\n";
+    return 0;
 }
 
-void print_configuration() {
-    cerr << "State: " << state << "\n";
-    for (size_t a = 0; a < tapes.size(); ++a) {
-        size_t before_head = 0, after_head = 0;
-        ostringstream oss;
-        oss << "Tape " << (a + 1) << ": ";
-        for (size_t b = 0; b < tapes[a].size(); ++b) {
-            if (b == heads[a])
-                before_head = oss.str().length();
-            oss << tapes[a][b];
-            if (b == heads[a])
-                after_head = oss.str().length();
+// runs the machine on every line of the batch file, printing the results in the input order
+static int run_batch(const CompiledMachine &cm) {
+    ifstream file;
+    if (batch_file != "-") {
+        file.open(batch_file);
+        if (!file) {
+            cerr << "ERROR: File " << batch_file << " does not exist\n";
+            return 1;
+        }
+    }
+    istream &input = batch_file == "-" ? cin : file;
+    vector<string> lines;
+    for (string line; getline(input, line);) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        lines.emplace_back(line);
+    }
+
+    if (num_threads == 0)
+        num_threads = max(1u, thread::hardware_concurrency());
+    if (lazy)
+        num_threads = 1; // the transitions are made while the machine runs
+    vector<Simulator> sims(min<size_t>(num_threads, max<size_t>(lines.size(), 1)), Simulator(cm));
+    for (auto &sim : sims)
+        configure(sim);
+    vector<string> results(lines.size());
+    parallel_for(lines.size(), (unsigned)sims.size(), [&](unsigned worker, size_t i) {
+        vector<string> word = cm.parse_input(lines[i]);
+        if (word.empty() && lines[i] != "") {
+            results[i] = "ERROR";
+            return;
         }
-        cerr << oss.str() << "\n";
-        for (size_t b = 0; b < before_head; ++b)
-            cerr << " ";
-        for (size_t b = before_head; b < after_head; ++b)
-            cerr << "^";
-        cerr << "\n";
-    }
-    cerr << "#####################################\n";
+        Simulator &sim = sims[worker];
+        sim.start(cm.encode(word));
+        sim.run(max_steps);
+        results[i] = string(result_name(sim.status)) + " " + to_string(sim.steps) + cycle_info(sim);
+    });
+
+    for (const auto &result : results)
+        cout << result << "\n";
+    return 0;
+}
+
+// reads the value of an option given as "name=value" or "name value" (or "-xvalue" for short options)
+static bool read_option(const string &name, int &i, int argc, char *argv[], string &value) {
+    string arg = argv[i];
+    if (arg.compare(0, name.length() + 1, name + "=") == 0) {
+        value = arg.substr(name.length() + 1);
+        return true;
+    }
+    if (name.length() == 2 && arg.length() > 2 && arg.compare(0, 2, name) == 0) {
+        value = arg.substr(2);
+        return true;
+    }
+    if (arg != name)
+        return false;
+    if (i + 1 >= argc)
+        print_usage("Missing value of " + name);
+    value = argv[++i];
+    return true;
+}
+
+static unsigned long long read_number(const string &name, const string &value) {
+    try {
+        size_t last;
+        unsigned long long res = stoull(value, &last);
+        if (last == value.length() && value[0] != '-')
+            return res;
+    } catch (...) {
+    }
+    print_usage("Nonnegative integer expected as the value of " + name);
+    return 0;
 }
 
 int main(int argc, char* argv[]) {
     string filename;
     string input;
+    string value;
     int ok = 0;
     for (int i = 1; i < argc; i++) {
         string arg = argv[i];
         if (arg == "--quiet" || arg == "-q")
             verbose = false;
+        else if (arg == "--steps" || arg == "-s")
+            print_steps = true;
+        else if (arg == "--no-sweeps")
+            use_sweeps = false;
+        else if (arg == "--left-edge=reject")
+            left_edge = LEFT_EDGE_REJECT;
+        else if (arg == "--left-edge=extend")
+            left_edge = LEFT_EDGE_EXTEND;
+        else if (read_option("--max-steps", i, argc, argv, value))
+            max_steps = read_number("--max-steps", value);
+        else if (read_option("--max-cells", i, argc, argv, value))
+            max_cells = read_number("--max-cells", value);
+        else if (arg == "--detect-cycles")
+            detect_cycles = true;
+        else if (arg == "--reduce")
+            reduce = true;
+        else if (read_option("--trace", i, argc, argv, value))
+            trace_file = value;
+        else if (read_option("--trace-snapshots", i, argc, argv, value))
+            trace_snapshots = read_number("--trace-snapshots", value);
+        else if (arg == "--profile")
+            profile = true;
+        else if (read_option("--profile-json", i, argc, argv, value))
+            profile_json = value;
+        else if (read_option("--checkpoint", i, argc, argv, value))
+            checkpoint_file = value;
+        else if (read_option("--checkpoint-snapshots", i, argc, argv, value))
+            checkpoint_snapshots = read_number("--checkpoint-snapshots", value);
+        else if (arg == "--resume")
+            resume = true;
+        else if (read_option("--seek", i, argc, argv, value)) {
+            seek = true;
+            seek_step = read_number("--seek", value);
+        } else if (read_option("--batch", i, argc, argv, value))
+            batch_file = value;
+        else if (read_option("--threads", i, argc, argv, value) || read_option("-j", i, argc, argv, value))
+            num_threads = (unsigned)read_number("--threads", value);
         else {
             if (ok == 0)
                 filename = arg;
             else
-            if (ok == 1)
+            if (ok == 1 && batch_file.empty())
                 input = arg;
             else
                 print_usage("Too many arguments");
             ++ok;
         }
     }
-    if (ok != 2)
+    // a resumed run, or a run in which a step is sought, can take its input from the checkpoint
+    bool input_in_checkpoint = !checkpoint_file.empty() && (resume || seek);
+    if (ok > (batch_file.empty() ? 2 : 1))
+        print_usage("Too many arguments");
+    if (ok < (batch_file.empty() && !input_in_checkpoint ? 2 : 1))
         print_usage("Not enough arguments");
+    bool has_input = ok == 2;
+    if (resume && checkpoint_file.empty())
+        print_usage("A run can be resumed only from a checkpoint");
+    if (resume && seek)
+        print_usage("A step cannot be sought in a resumed run");
+    if ((resume || seek) && !trace_file.empty())
+        print_usage("A resumed run cannot be traced");
 
-    FILE *f = fopen(filename.c_str(), "r");
-    if (!f) {
-        cerr << "ERROR: File " << filename << " does not exist\n";
-        return 1;
+    if (reduce && (!trace_file.empty() || profile || !profile_json.empty() || !checkpoint_file.empty()))
+        print_usage("A run of a reduced machine cannot be traced, profiled or checkpointed");
+
+    unique_ptr<CompiledMachine> machine;
+    unique_ptr<LazyMachine> lazy_machine;
+    if (reduce) {
+        // the two-tape machine is reduced to one tape while it runs
+        if (is_binary_machine_file(filename))
+            print_usage("Only a machine in the text format can be reduced");
+        FILE *f = fopen(filename.c_str(), "r");
+        if (!f) {
+            cerr << "ERROR: File " << filename << " does not exist\n";
+            return 1;
+        }
+        TuringMachine tm = read_tm_from_file(f);
+        if (tm.num_tapes != 2) {
+            cerr << "ERROR: Only a two-tape machine can be reduced\n";
+            return 1;
+        }
+        lazy_machine.reset(new LazyMachine(tm));
+        lazy = lazy_machine.get();
+    } else
+        machine = read_compiled_machine(filename);
+    const CompiledMachine &cm = lazy ? lazy->machine() : *machine;
+    if (!batch_file.empty()) {
+        if (!trace_file.empty())
+            print_usage("A batch run cannot be traced");
+        if (profile || !profile_json.empty())
+            print_usage("A batch run cannot be profiled");
+        if (!checkpoint_file.empty() || seek)
+            print_usage("A batch run cannot be checkpointed");
+        verbose = false;
+        return run_batch(cm);
     }
-    TuringMachine tm = read_tm_from_file(f);
-    tapes.resize(tm.num_tapes);
-    heads.resize(tm.num_tapes);
-    tapes[0] = tm.parse_input(input);
-    if (tapes[0].empty() && input != "") {
+
+    vector<string> word = cm.parse_input(input);
+    if (word.empty() && input != "") {
         cerr << "ERROR: The last argument is not a sequence of input letters\n";
         return 1;
     }
-    append_blanks_under_heads();
+    Simulator sim(cm);
+    configure(sim);
+    unique_ptr<Checkpoint> checkpoint;
+    if (!checkpoint_file.empty()) {
+        if (resume || seek) {
+            checkpoint.reset(new Checkpoint(checkpoint_file, cm, false));
+            if (has_input && cm.encode(word) != checkpoint->word) {
+                cerr << "ERROR: The checkpoint was made for a different input\n";
+                return 1;
+            }
+        } else
+            checkpoint.reset(new Checkpoint(checkpoint_file, cm, true, cm.encode(word), checkpoint_snapshots));
+    }
+
+    if (seek) {
+        // the nearest earlier snapshot is restored and the run is replayed from it
+        if (!checkpoint || !checkpoint->restore(sim, seek_step))
+            sim.start(checkpoint ? checkpoint->word : cm.encode(word));
+        if (sim.steps < seek_step)
+            sim.run(seek_step);
+        if (sim.steps != seek_step) {
+            cerr << "The run ended after " << sim.steps << " steps\n";
+            return halt(sim);
+        }
+        cerr << "Step: " << seek_step << "\n";
+        sim.print_configuration(cerr);
+        return 0;
+    }
 
     if (verbose)
-        print_configuration();
-    for (;;) {
-        execute_step(tm);
+        sim.use_sweeps = false; // every configuration is printed
+    unique_ptr<TraceWriter> trace;
+    if (!trace_file.empty()) {
+        trace.reset(new TraceWriter(trace_file, cm, trace_snapshots));
+        sim.trace = trace.get();
+    }
+    unique_ptr<Profiler> profiler;
+    if (profile || !profile_json.empty()) {
+        profiler.reset(new Profiler(cm));
+        sim.profile = profiler.get();
+    }
+    if (!resume || !checkpoint->restore(sim))
+        sim.start(checkpoint ? checkpoint->word : cm.encode(word));
+
+    if (verbose)
+        sim.print_configuration(cerr);
+    while (sim.step(max_steps) == STATUS_RUNNING) {
         if (verbose)
-            print_configuration();
-        if (state == REJECTING_STATE)
-            halt(false);
-        if (state == ACCEPTING_STATE)
-            halt(true);
+            sim.print_configuration(cerr);
+        if (checkpoint && checkpoint->snapshot_due(sim.steps))
+            checkpoint->save(sim);
+    }
+    if (verbose && (sim.status == STATUS_ACCEPT || sim.status == STATUS_REJECT))
+        sim.print_configuration(cerr);
+    if (trace)
+        trace->halt(sim);
+    if (profile)
+        profiler->print_report(cerr, sim);
+    if (!profile_json.empty()) {
+        ofstream output(profile_json);
+        if (!output) {
+            cerr << "ERROR: Cannot write to file " << profile_json << "\n";
+            return 1;
+        }
+        profiler->print_json(output, sim);
     }
+    return halt(sim);
 }
- 
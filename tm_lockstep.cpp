@@ -0,0 +1,359 @@
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <thread>
+#include "turing_machine.h"
+#include "compiled_machine.h"
+#include "simulator.h"
+#include "thread_pool.h"
+#include "words.h"
+
+using namespace std;
+
+// Runs a two-tape machine and its reduction (REDUCTION_PER_TRANSITION) side by side on generated words.
+// Before every step of the two-tape machine the configuration of the reduction is decoded and compared
+// with the two-tape one; the steps made by the reduction for every simulated step are counted per word length.
+
+static void print_usage(string error) {
+    cerr << "ERROR: " << error << "\n"
+         << "Usage: tm_lockstep [--max-length <n>] [--words <n>] [--max-steps <n>] [--gap <k>] [--seed <n>]\n"
+         << "                   [-j|--threads <n>] <two-tape TM definition>\n";
+    exit(1);
+}
+
+// the steps made by the reduction for the simulated steps of the runs on words of a single length
+struct LengthStats {
+    unsigned long long words = 0, limited = 0, steps = 0, reduced_steps = 0;
+    map<unsigned long long, unsigned long long> per_step; // reduced steps of a simulated step -> count
+
+    void add(const LengthStats &other) {
+        words += other.words;
+        limited += other.limited;
+        steps += other.steps;
+        reduced_steps += other.reduced_steps;
+        for (const auto &count : other.per_step)
+            per_step[count.first] += count.second;
+    }
+
+    // the least number of reduced steps of at least the given fraction of the simulated steps
+    unsigned long long percentile(double fraction) const {
+        unsigned long long total = 0, seen = 0;
+        for (const auto &count : per_step)
+            total += count.second;
+        for (const auto &count : per_step)
+            if ((seen += count.second) >= fraction * total)
+                return count.first;
+        return 0;
+    }
+};
+
+static const symbol_t NO_LETTER = (symbol_t)-1;
+static const state_t NO_STATE = (state_t)-1;
+
+class Lockstep {
+public:
+    const CompiledMachine &two, &one;
+
+    Lockstep(const CompiledMachine &two_, const CompiledMachine &one_, const ReductionDecoder &decoder)
+        : two(two_), one(one_), cells(one_.letters.size()), step_starts(one_.states.size()) {
+        for (size_t a = 0; a < one.letters.size(); ++a) {
+            string letter;
+            cells[a].first = decoder.decode_letter(one.letters[a], letter);
+            auto it = two.letter_ids.find(letter);
+            if (cells[a].first == REDUCED_LETTER || cells[a].first == REDUCED_HEAD)
+                cells[a].second = it == two.letter_ids.end() ? NO_LETTER : it->second;
+        }
+        for (size_t a = 0; a < one.states.size(); ++a) {
+            string state;
+            vector<string> under_heads;
+            StepStart &start = step_starts[a];
+            if (!decoder.decode_step_start(one.states[a], state, under_heads))
+                continue;
+            auto it = two.state_ids.find(state);
+            start.is_start = true;
+            start.state = it == two.state_ids.end() ? NO_STATE : it->second;
+            for (const auto &letter : under_heads) {
+                auto letter_it = two.letter_ids.find(letter);
+                start.under_heads.push_back(letter_it == two.letter_ids.end() ? NO_LETTER : letter_it->second);
+            }
+        }
+    }
+
+    // runs both machines on the word; returns the description of the first divergence, or "" if there is none
+    string run(const vector<string> &word, Simulator &sim_two, Simulator &sim_one, unsigned long long max_steps,
+               LengthStats &stats) const {
+        ++stats.words;
+        sim_two.start(two.encode(word));
+        sim_one.start(one.encode(word));
+        if (!advance(sim_one))
+            return "the reduction did not get to the first step";
+        for (;;) {
+            if (sim_one.status == STATUS_RUNNING) {
+                string difference = compare(sim_two, sim_one);
+                if (!difference.empty())
+                    return "before step " + to_string(sim_two.steps + 1) + ": " + difference
+                           + "\n" + configurations(sim_two, sim_one);
+            }
+            if (sim_two.status != STATUS_RUNNING || sim_one.status != STATUS_RUNNING)
+                break;
+            if (max_steps && sim_two.steps >= max_steps) {
+                ++stats.limited;
+                stats.steps += sim_two.steps;
+                stats.reduced_steps += sim_one.steps;
+                return "";
+            }
+            unsigned long long steps = sim_two.steps, reduced_steps = sim_one.steps;
+            sim_two.step();
+            if (sim_two.steps == steps)
+                break; // the machine halted without a step
+            if (!advance(sim_one))
+                return "step " + to_string(sim_two.steps) + " is not finished by the reduction\n"
+                       + configurations(sim_two, sim_one);
+            ++stats.per_step[sim_one.steps - reduced_steps];
+        }
+        while (sim_one.status == STATUS_RUNNING)
+            if (!advance(sim_one))
+                return "the reduction does not halt after step " + to_string(sim_two.steps);
+        if (sim_two.status == STATUS_RUNNING) {
+            // the reduction halted, so the machine has to halt without a step
+            unsigned long long steps = sim_two.steps;
+            string before = configurations(sim_two, sim_one);
+            if (sim_two.step() == STATUS_RUNNING || sim_two.steps != steps)
+                return "the reduction " + result(sim_one) + " instead of making step " + to_string(steps + 1)
+                       + "\n" + before;
+        }
+        stats.steps += sim_two.steps;
+        stats.reduced_steps += sim_one.steps;
+        if (sim_two.status == STATUS_RUNNING || (sim_two.status == STATUS_ACCEPT) != (sim_one.status == STATUS_ACCEPT))
+            return "after step " + to_string(sim_two.steps) + " the machine " + result(sim_two)
+                   + ", but the reduction " + result(sim_one) + "\n" + configurations(sim_two, sim_one);
+        return "";
+    }
+
+private:
+    struct StepStart {
+        bool is_start = false;
+        state_t state;
+        vector<symbol_t> under_heads;
+    };
+    vector<pair<reduced_cell_t, symbol_t>> cells; // letter of the reduction -> its kind and the letter it holds
+    vector<StepStart> step_starts; // state of the reduction -> the simulated step it starts
+
+    // runs the reduction until it starts the next simulated step or halts; a simulated step walks
+    // over the used part of the tape a few times, so a run much longer than that has gone astray
+    bool advance(Simulator &sim) const {
+        unsigned long long max_steps = sim.steps + 16 * (sim.tapes[0].used_cells() + 16);
+        do
+            sim.step(max_steps);
+        while (sim.status == STATUS_RUNNING && !step_starts[sim.state].is_start);
+        return sim.status != STATUS_LIMIT;
+    }
+
+    static string result(const Simulator &sim) {
+        switch (sim.status) {
+        case STATUS_RUNNING:
+            return "runs";
+        case STATUS_ACCEPT:
+            return "accepts";
+        default:
+            return "rejects";
+        }
+    }
+
+    static string configurations(const Simulator &sim_two, const Simulator &sim_one) {
+        ostringstream res;
+        res << "Two-tape machine:\n";
+        sim_two.print_configuration(res);
+        res << "Reduction:\n";
+        sim_one.print_configuration(res);
+        return res.str();
+    }
+
+    // compares the configuration of the reduction at the start of a simulated step with the two-tape one
+    string compare(const Simulator &sim_two, const Simulator &sim_one) const {
+        const StepStart &start = step_starts[sim_one.state];
+        if (start.state != sim_two.state)
+            return "the reduction is in " + sim_one.cm.states[sim_one.state] + " instead of a state of "
+                   + two.states[sim_two.state];
+        vector<vector<symbol_t>> tapes(2);
+        vector<long> heads(2, -1);
+        size_t tape = 0;
+        const Tape &cells_one = sim_one.tapes[0];
+        for (long pos = cells_one.first_cell(); pos <= cells_one.last_cell(); ++pos) {
+            const auto &cell = cells[cells_one.get(pos)];
+            string at = "cell " + to_string(pos) + " of the reduction";
+            switch (cell.first) {
+            case REDUCED_HEAD:
+                if (tape == 2 || heads[tape] != -1)
+                    return at + " is a second head of a tape";
+                heads[tape] = (long)tapes[tape].size();
+                // fall through
+            case REDUCED_LETTER:
+                if (cell.second == NO_LETTER)
+                    return at + " holds a letter the machine does not have";
+                if (tape == 2) {
+                    if (cell.second != two.blank)
+                        return at + " is not blank after the end of the tapes";
+                    break;
+                }
+                tapes[tape].push_back(cell.second);
+                break;
+            case REDUCED_PADDING:
+                if (tape != 0)
+                    return at + " is padding outside of the first tape";
+                tapes[tape].push_back(two.blank);
+                break;
+            case REDUCED_BORDER:
+            case REDUCED_END:
+                if (tape != (cell.first == REDUCED_BORDER ? 0u : 1u))
+                    return at + " is a misplaced end of a tape";
+                ++tape;
+                break;
+            default:
+                return at + " is not a letter of the reduction";
+            }
+        }
+        if (tape != 2)
+            return "the reduction has no end of a tape";
+        for (size_t a = 0; a < 2; ++a) {
+            string name = "tape " + to_string(a + 1);
+            if (heads[a] != sim_two.heads[a])
+                return "the head of " + name + " is at " + to_string(heads[a]) + " instead of "
+                       + to_string(sim_two.heads[a]);
+            const Tape &cells_two = sim_two.tapes[a];
+            long last = max<long>((long)tapes[a].size() - 1, cells_two.last_cell());
+            for (long pos = 0; pos <= last; ++pos) {
+                symbol_t letter = pos < (long)tapes[a].size() ? tapes[a][pos] : two.blank;
+                if (letter != cells_two.get_or_blank(pos))
+                    return "cell " + to_string(pos) + " of " + name + " holds " + two.letters[letter] + " instead of "
+                           + two.letters[cells_two.get_or_blank(pos)];
+            }
+            if (start.under_heads[a] != cells_two.get_or_blank(sim_two.heads[a]))
+                return "the state " + one.states[sim_one.state] + " is not of the letter under the head of " + name;
+        }
+        return "";
+    }
+};
+
+static unsigned long long read_number(const string &name, const string &value) {
+    try {
+        size_t last;
+        unsigned long long res = stoull(value, &last);
+        if (last == value.length() && value[0] != '-')
+            return res;
+    } catch (...) {
+    }
+    print_usage("Nonnegative integer expected as the value of " + name);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    size_t max_length = 8, num_words = 1000;
+    unsigned long long max_steps = 100000;
+    unsigned gap = 1, num_threads = 0;
+    uint64_t seed = 1;
+    string filename;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg.empty() || arg[0] != '-') {
+            if (!filename.empty())
+                print_usage("Too many arguments");
+            filename = arg;
+            continue;
+        }
+        if (i + 1 >= argc)
+            print_usage("Missing value of " + arg);
+        string value = argv[++i];
+        if (arg == "--max-length")
+            max_length = read_number(arg, value);
+        else if (arg == "--words")
+            num_words = read_number(arg, value);
+        else if (arg == "--max-steps")
+            max_steps = read_number(arg, value);
+        else if (arg == "--gap")
+            gap = (unsigned)read_number(arg, value);
+        else if (arg == "--seed")
+            seed = read_number(arg, value);
+        else if (arg == "-j" || arg == "--threads")
+            num_threads = (unsigned)read_number(arg, value);
+        else
+            print_usage("Unknown option " + arg);
+    }
+    if (filename.empty())
+        print_usage("Not enough arguments");
+    if (gap == 0)
+        print_usage("The gap has to be positive");
+    if (gap > MAX_GAP)
+        print_usage("The gap can be at most " + to_string(MAX_GAP));
+    if (num_words == 0)
+        print_usage("At least one word of every length is needed");
+    if (num_threads == 0)
+        num_threads = max(1u, thread::hardware_concurrency());
+
+    FILE *f = fopen(filename.c_str(), "r");
+    if (!f) {
+        cerr << "ERROR: File " << filename << " does not exist\n";
+        return 1;
+    }
+    TuringMachine tm = read_tm_from_file(f);
+    if (tm.num_tapes != 2) {
+        cerr << "ERROR: Only a two-tape machine can be reduced\n";
+        return 1;
+    }
+    if (tm.input_alphabet.empty()) {
+        cerr << "ERROR: The machine has no input letters\n";
+        return 1;
+    }
+    TuringMachine reduced = tm.reduce_two_tapes_to_one(REDUCTION_PER_TRANSITION, num_threads, gap);
+    ReductionDecoder decoder(tm);
+    CompiledMachine two(tm), one(reduced);
+    Lockstep lockstep(two, one, decoder);
+
+    vector<vector<string>> words = make_words(tm.input_alphabet, max_length, num_words, seed);
+    vector<Simulator> sims_two(num_threads, Simulator(two)), sims_one(num_threads, Simulator(one));
+    for (auto &sim : sims_two)
+        sim.use_sweeps = false; // every step is compared
+    vector<vector<LengthStats>> stats(num_threads, vector<LengthStats>(max_length + 1));
+    vector<string> divergences(words.size());
+    parallel_for(words.size(), num_threads, [&](unsigned worker, size_t i) {
+        divergences[i] = lockstep.run(words[i], sims_two[worker], sims_one[worker], max_steps,
+                                      stats[worker][words[i].size()]);
+    });
+
+    cout << "length  words  limited  steps  reduced_steps  ratio  per_step_mean  p50  p90  p99  max\n";
+    for (size_t length = 0; length <= max_length; ++length) {
+        LengthStats total;
+        for (const auto &worker_stats : stats)
+            total.add(worker_stats[length]);
+        unsigned long long counted = 0, sum = 0;
+        for (const auto &count : total.per_step) {
+            counted += count.second;
+            sum += count.first * count.second;
+        }
+        cout << length << "  " << total.words << "  " << total.limited << "  " << total.steps << "  "
+             << total.reduced_steps << "  " << (total.steps ? (double)total.reduced_steps / total.steps : 0.0) << "  "
+             << (counted ? (double)sum / counted : 0.0) << "  " << total.percentile(0.5) << "  "
+             << total.percentile(0.9) << "  " << total.percentile(0.99) << "  "
+             << (total.per_step.empty() ? 0 : total.per_step.rbegin()->first) << "\n";
+    }
+
+    size_t divergent = 0;
+    for (size_t i = 0; i < words.size(); ++i) {
+        if (divergences[i].empty())
+            continue;
+        if (!divergent++) {
+            string word;
+            for (const auto &letter : words[i])
+                word += letter;
+            cout << "First divergence, on the word \"" << word << "\" " << divergences[i] << "\n";
+        }
+    }
+    if (divergent) {
+        cout << "DIVERGED on " << divergent << " of " << words.size() << " words\n";
+        return 1;
+    }
+    cout << "OK " << words.size() << " words\n";
+    return 0;
+}
@@ -0,0 +1,34 @@
+#include <fstream>
+#include <iostream>
+#include "minimize.h"
+#include "turing_machine.h"
+
+using namespace std;
+
+static void print_usage(string error) {
+    cerr << "ERROR: " << error << "\n"
+         << "Usage: tm_minimize <input_file> <where to save the minimized machine>\n";
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3)
+        print_usage(argc < 3 ? "Not enough arguments" : "Too many arguments");
+    string filename = argv[1], output_filename = argv[2];
+
+    FILE *f = fopen(filename.c_str(), "r");
+    if (!f) {
+        cerr << "ERROR: File " << filename << " does not exist\n";
+        return 1;
+    }
+    TuringMachine tm = read_tm_from_file(f);
+    TuringMachine minimized = minimize_machine(tm);
+
+    ofstream output(output_filename);
+    if (!output || !(output << minimized) || !output.flush()) {
+        cerr << "ERROR: Cannot write to file " << output_filename << "\n";
+        return 1;
+    }
+    cout << "States: " << tm.set_of_states().size() << " -> " << minimized.set_of_states().size()
+         << ", transitions: " << tm.transitions.size() << " -> " << minimized.transitions.size() << "\n";
+}
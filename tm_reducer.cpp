@@ -1,27 +1,60 @@
 #include <iostream>
-#include <sstream>
-#include <fstream>
+#include <thread>
+#include "compiled_machine.h"
 #include "turing_machine.h"
 
 using namespace std;
 
 static void print_usage(string error) {
     cerr << "ERROR: " << error << "\n"
-         << "Usage: tm_reducer <two tape machine file> <where to save one tape machine>\n";
+         << "Usage: tm_reducer [--layout=split|tracks] [--shared-helpers] [--schedule=round-trip|boustrophedon] [--generation-order] [--gap <k>] [-j|--threads <n>] <two tape machine file> <where to save one tape machine>\n"
+         << "  the one tape machine is saved in the binary format if the file name ends with " BINARY_MACHINE_EXTENSION "\n";
     exit(1);
 }
 
 
 int main(int argc, char *argv[]) {
-    string filename;
+    string filename, output_filename;
+    reduction_t reduction = REDUCTION_PER_TRANSITION;
+    bool tracks = false;
+    bool boustrophedon = false;
+    bool generation_order = false;
+    unsigned gap = 1;
+    unsigned num_threads = max(1u, thread::hardware_concurrency());
 
     int ok = 0;
     for (int i = 1; i < argc; i++) {
         string arg = argv[i];
 
+        if (arg == "--shared-helpers") {
+            reduction = REDUCTION_SHARED_HELPERS;
+            continue;
+        }
+        if (arg == "--layout=split" || arg == "--layout=tracks") {
+            tracks = arg == "--layout=tracks";
+            continue;
+        }
+        if (arg == "--schedule=round-trip" || arg == "--schedule=boustrophedon") {
+            boustrophedon = arg == "--schedule=boustrophedon";
+            continue;
+        }
+        if (arg == "--generation-order") {
+            generation_order = true;
+            continue;
+        }
+        if (arg == "--threads" || arg == "-j" || arg == "--gap") {
+            if (i + 1 >= argc)
+                print_usage("Missing value of " + arg);
+            string value = argv[++i];
+            if (value.empty() || value.find_first_not_of("0123456789") != string::npos || value.length() > 9 || stoul(value) == 0)
+                print_usage("Positive integer expected as the value of " + arg);
+            (arg == "--gap" ? gap : num_threads) = (unsigned)stoul(value);
+            continue;
+        }
         if (ok == 0)
             filename = arg;
-        else if (ok == 1) {}
+        else if (ok == 1)
+            output_filename = arg;
         else
             print_usage("Too many arguments");
         ++ok;
@@ -29,6 +62,21 @@ int main(int argc, char *argv[]) {
 
     if (ok != 2)
         print_usage("Not enough arguments");
+    // the states of a shift hold up to gap cells of the second tape
+    if (gap > MAX_GAP)
+        print_usage("The gap can be at most " + to_string(MAX_GAP));
+    if (gap > 1 && (tracks || reduction == REDUCTION_SHARED_HELPERS))
+        print_usage("The gap can be used only with the split layout and without shared helpers");
+    if (tracks) {
+        if (reduction == REDUCTION_SHARED_HELPERS)
+            print_usage("The tracks layout has no option of shared helpers");
+        reduction = REDUCTION_TRACKS;
+    }
+    if (boustrophedon) {
+        if (reduction != REDUCTION_PER_TRANSITION || gap > 1)
+            print_usage("The boustrophedon schedule can be used only with the split layout, without shared helpers and gap");
+        reduction = REDUCTION_BOUSTROPHEDON;
+    }
 
     FILE *f = fopen(filename.c_str(), "r");
     if (!f) {
@@ -37,8 +85,20 @@ int main(int argc, char *argv[]) {
     }
 
     TuringMachine tm = read_tm_from_file(f);
-    auto reduced_tm = tm.reduce_two_tapes_to_one();
-    
-    ofstream f_out(argv[2]);
-    reduced_tm.save_to_file(f_out);
+
+    if (has_binary_extension(output_filename)) {
+        // the binary format needs all the names at once, so the machine is reduced in memory
+        CompiledMachine cm(tm.reduce_two_tapes_to_one(reduction, num_threads, gap));
+        if (!cm.save_binary(output_filename)) {
+            cerr << "ERROR: Cannot write to file " << output_filename << "\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    FILE *f_out = fopen(output_filename.c_str(), "w");
+    if (!f_out || !tm.save_reduction_to_file(f_out, reduction, num_threads, generation_order, gap) || fclose(f_out) != 0) {
+        cerr << "ERROR: Cannot write to file " << output_filename << "\n";
+        return 1;
+    }
 }
@@ -0,0 +1,54 @@
+#include <iostream>
+#include <cstdlib>
+#include "turing_machine.h"
+#include "compiled_machine.h"
+#include "simulator.h"
+#include "trace.h"
+
+using namespace std;
+
+static void print_usage(string error) {
+    cerr << "ERROR: " << error << "\n"
+         << "Usage: tm_trace <input_file> <trace_file> <step> [<last_step>]\n";
+    exit(1);
+}
+
+static unsigned long long read_step(const string &arg) {
+    try {
+        size_t last;
+        unsigned long long res = stoull(arg, &last);
+        if (last == arg.length() && arg[0] != '-')
+            return res;
+    } catch (...) {
+    }
+    print_usage("Step number expected");
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 4)
+        print_usage("Not enough arguments");
+    if (argc > 5)
+        print_usage("Too many arguments");
+    unsigned long long first_step = read_step(argv[3]);
+    unsigned long long last_step = argc == 5 ? read_step(argv[4]) : first_step;
+
+    auto machine = read_compiled_machine(argv[1]);
+    const CompiledMachine &cm = *machine;
+    TraceReader trace(argv[2]);
+    if (trace.num_tapes != cm.num_tapes || trace.num_states != cm.states.size() || trace.num_letters != cm.letters.size()) {
+        cerr << "ERROR: The trace was not recorded for this machine\n";
+        return 1;
+    }
+
+    // only the first step is sought, the run is replayed from it to the others
+    Simulator sim(cm);
+    for (unsigned long long step = first_step; step <= last_step; ++step) {
+        if (!(step == first_step ? trace.seek(sim, step) : trace.forward(sim, step))) {
+            cerr << "The run ended after " << sim.steps << " steps\n";
+            break;
+        }
+        cerr << "Step: " << step << "\n";
+        sim.print_configuration(cerr);
+    }
+}
@@ -0,0 +1,360 @@
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "simulator.h"
+#include "trace.h"
+
+using namespace std;
+
+TraceWriter::TraceWriter(const string &filename, const CompiledMachine &cm, unsigned long long snapshot_distance_)
+    : num_tapes(cm.num_tapes), snapshot_distance(snapshot_distance_ ? snapshot_distance_ : 1), last_snapshot(0), written(0) {
+    file = fopen(filename.c_str(), "wb");
+    if (!file)
+        machine_error("Cannot write to file " + filename);
+    buffer.reserve(BUFFER_SIZE + 64);
+    for (const char *c = TRACE_MAGIC; *c; ++c)
+        put_byte(*c);
+    put_number(cm.num_tapes);
+    put_number(cm.states.size());
+    put_number(cm.letters.size());
+    put_number(snapshot_distance);
+}
+
+TraceWriter::~TraceWriter() {
+    unsigned long long index_offset = written + buffer.size();
+    put_byte('I');
+    put_number(index.size());
+    for (const auto &entry : index) {
+        put_number(entry.first);
+        put_number(entry.second);
+    }
+    for (int a = 0; a < 8; ++a)
+        put_byte((unsigned char)(index_offset >> (8 * a)));
+    for (const char *c = INDEX_MAGIC; *c; ++c)
+        put_byte(*c);
+    flush();
+    fclose(file);
+}
+
+void TraceWriter::put_number(unsigned long long value) {
+    while (value >= 0x80) {
+        put_byte((unsigned char)(value | 0x80));
+        value >>= 7;
+    }
+    put_byte((unsigned char)value);
+}
+
+void TraceWriter::put_signed(long long value) {
+    put_number(((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63));
+}
+
+void TraceWriter::flush() {
+    if (fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size())
+        machine_error("Cannot write the trace");
+    written += buffer.size();
+    buffer.clear();
+}
+
+void TraceWriter::step(state_t new_state, const uint32_t *actions) {
+    put_byte('S');
+    put_number(new_state);
+    for (int a = 0; a < num_tapes; ++a)
+        put_number(actions[a]);
+    if (buffer.size() >= BUFFER_SIZE)
+        flush();
+}
+
+void TraceWriter::sweep(int tape, long distance) {
+    put_byte('W');
+    put_number(tape);
+    put_signed(distance);
+    if (buffer.size() >= BUFFER_SIZE)
+        flush();
+}
+
+void TraceWriter::snapshot(const Simulator &sim) {
+    index.emplace_back(sim.steps, written + buffer.size());
+    put_byte('C');
+    put_number(sim.steps);
+    put_number(sim.state);
+    for (int a = 0; a < num_tapes; ++a) {
+        const Tape &tape = sim.tapes[a];
+        put_signed(sim.heads[a]);
+        put_signed(tape.first_cell());
+        put_number(tape.used_cells());
+        for (long pos = tape.first_cell(); pos <= tape.last_cell(); ++pos) {
+            symbol_t letter = tape.get(pos);
+            put_byte((unsigned char)letter);
+            put_byte((unsigned char)(letter >> 8));
+            if (buffer.size() >= BUFFER_SIZE)
+                flush();
+        }
+    }
+    last_snapshot = sim.steps;
+    if (buffer.size() >= BUFFER_SIZE)
+        flush();
+}
+
+void TraceWriter::halt(const Simulator &sim) {
+    put_byte('H');
+    put_number(sim.status);
+    put_number(sim.steps);
+}
+
+TraceReader::TraceReader(const string &filename) : cursor(0), sweep_tape(0), sweep_rest(0) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        machine_error("File " + filename + " does not exist");
+    struct stat file_stat;
+    size_t magic_length = strlen(TRACE_MAGIC);
+    if (fstat(fd, &file_stat) != 0 || (size_t)file_stat.st_size < magic_length) {
+        close(fd);
+        corrupted();
+    }
+    void *address = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED)
+        machine_error("Cannot map file " + filename);
+    mapping.address = address;
+    mapping.size = file_stat.st_size;
+    data = (const unsigned char *)address;
+    size = mapping.size;
+    if (memcmp(data, TRACE_MAGIC, magic_length) != 0)
+        corrupted();
+    size_t pos = magic_length;
+    num_tapes = (int)get_number(pos);
+    num_states = get_number(pos);
+    num_letters = get_number(pos);
+    snapshot_distance = get_number(pos);
+    start = pos;
+
+    size_t index_magic_length = strlen(INDEX_MAGIC);
+    if (size >= start + 8 + index_magic_length
+            && memcmp(&data[size - index_magic_length], INDEX_MAGIC, index_magic_length) == 0) {
+        unsigned long long index_offset = 0;
+        for (int a = 7; a >= 0; --a)
+            index_offset = (index_offset << 8) | data[size - index_magic_length - 8 + a];
+        pos = index_offset;
+        if (pos >= size || data[pos++] != 'I')
+            corrupted();
+        unsigned long long count = get_number(pos);
+        for (unsigned long long a = 0; a < count; ++a) {
+            unsigned long long steps = get_number(pos);
+            index.emplace_back(steps, get_number(pos));
+        }
+        return;
+    }
+
+    // the run was interrupted before the index was written, so the snapshots have to be found
+    // (and the last record may be incomplete)
+    pos = start;
+    while (pos < size) {
+        size_t record = pos;
+        if (!complete_record(pos)) {
+            size = record;
+            break;
+        }
+        pos = record;
+        switch (data[pos++]) {
+        case 'S':
+            get_number(pos);
+            for (int a = 0; a < num_tapes; ++a)
+                get_number(pos);
+            break;
+        case 'W':
+            get_number(pos);
+            get_signed(pos);
+            break;
+        case 'C':
+            index.emplace_back(read_snapshot(nullptr, pos), record);
+            break;
+        case 'H':
+            get_number(pos);
+            get_number(pos);
+            break;
+        default:
+            pos = size;
+        }
+    }
+}
+
+TraceReader::Mapping::~Mapping() {
+    if (address)
+        munmap(address, size);
+}
+
+// checks whether the record starting at pos fits in the file
+bool TraceReader::complete_record(size_t pos) const {
+    auto skip_number = [&]() {
+        while (pos < size && (data[pos] & 0x80))
+            ++pos;
+        return pos++ < size;
+    };
+    switch (data[pos++]) {
+    case 'S':
+        for (int a = 0; a <= num_tapes; ++a)
+            if (!skip_number())
+                return false;
+        return true;
+    case 'W':
+    case 'H':
+        return skip_number() && skip_number();
+    case 'C':
+        if (!skip_number() || !skip_number())
+            return false;
+        for (int a = 0; a < num_tapes; ++a) {
+            if (!skip_number() || !skip_number())
+                return false;
+            size_t length_pos = pos;
+            if (!skip_number())
+                return false;
+            pos = length_pos;
+            pos += 2 * get_number(pos);
+            if (pos > size)
+                return false;
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+void TraceReader::corrupted() const {
+    machine_error("Invalid trace file");
+}
+
+unsigned long long TraceReader::get_number(size_t &pos) const {
+    unsigned long long res = 0;
+    for (int shift = 0;; shift += 7) {
+        if (pos >= size || shift > 63)
+            corrupted();
+        unsigned char byte = data[pos++];
+        res |= (unsigned long long)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return res;
+    }
+}
+
+long long TraceReader::get_signed(size_t &pos) const {
+    unsigned long long value = get_number(pos);
+    return (long long)(value >> 1) ^ -(long long)(value & 1);
+}
+
+unsigned long long TraceReader::read_snapshot(Simulator *sim, size_t &pos) const {
+    unsigned long long steps = get_number(pos);
+    unsigned long long state = get_number(pos);
+    if (state >= num_states)
+        corrupted();
+    if (sim) {
+        sim->steps = steps;
+        sim->state = state;
+        sim->status = STATUS_RUNNING;
+    }
+    for (int a = 0; a < num_tapes; ++a) {
+        long head = (long)get_signed(pos);
+        long first = (long)get_signed(pos);
+        unsigned long long length = get_number(pos);
+        // the used part of a tape contains cell 0 and the head
+        if (first > 0 || length > size || pos + 2 * length > size
+                || first + (long)length <= 0 || head < first || head >= first + (long)length)
+            corrupted();
+        if (sim) {
+            vector<symbol_t> cells(length);
+            for (unsigned long long b = 0; b < length; ++b) {
+                cells[b] = (symbol_t)(data[pos + 2 * b] | (data[pos + 2 * b + 1] << 8));
+                if (cells[b] >= num_letters)
+                    corrupted();
+            }
+            sim->heads[a] = head;
+            sim->tapes[a].assign(cells, first);
+        }
+        pos += 2 * length;
+    }
+    return steps;
+}
+
+bool TraceReader::seek(Simulator &sim, unsigned long long steps) {
+    // the records are decoded with the numbers of the header, so they have to match the machine
+    if (num_tapes != sim.cm.num_tapes || num_states != sim.cm.states.size() || num_letters != sim.cm.letters.size())
+        machine_error("The trace was not recorded for this machine");
+    if (index.empty())
+        corrupted();
+    size_t nearest = 0;
+    while (nearest + 1 < index.size() && index[nearest + 1].first <= steps)
+        ++nearest;
+    cursor = index[nearest].second;
+    if (cursor >= size || data[cursor++] != 'C')
+        corrupted();
+    // a snapshot after the sought step would make forward seek it again
+    unsigned long long snapshot_steps = read_snapshot(&sim, cursor);
+    if (snapshot_steps != index[nearest].first || snapshot_steps > steps)
+        corrupted();
+    sweep_rest = 0;
+    return forward(sim, steps);
+}
+
+// moves the head by the rest of the interrupted sweep, but at most to the given number of steps
+void TraceReader::replay_sweep(Simulator &sim, unsigned long long steps) {
+    unsigned long long length = sweep_rest < 0 ? -sweep_rest : sweep_rest;
+    length = min(length, steps - sim.steps);
+    long distance = sweep_rest < 0 ? -(long)length : (long)length;
+    sim.heads[sweep_tape] += distance;
+    sim.tapes[sweep_tape].reach(sim.heads[sweep_tape]);
+    sim.steps += length;
+    sweep_rest -= distance;
+}
+
+bool TraceReader::forward(Simulator &sim, unsigned long long steps) {
+    if (steps < sim.steps)
+        return seek(sim, steps);
+    if (sweep_rest)
+        replay_sweep(sim, steps);
+    size_t &pos = cursor;
+    while (sim.steps < steps && pos < size) {
+        switch (data[pos++]) {
+        case 'S': {
+            unsigned long long state = get_number(pos);
+            if (state >= num_states)
+                corrupted();
+            sim.state = (state_t)state;
+            for (int a = 0; a < num_tapes; ++a) {
+                unsigned long long action = get_number(pos);
+                if (action_letter((tape_action_t)action) >= num_letters || (action & 3) == 3 || action >> 16)
+                    corrupted();
+                sim.tapes[a].set(sim.heads[a], action_letter((tape_action_t)action));
+                sim.heads[a] += action_move(action);
+                sim.tapes[a].reach(sim.heads[a]);
+            }
+            ++sim.steps;
+            break;
+        }
+        case 'W': {
+            unsigned long long tape = get_number(pos);
+            if (tape >= (unsigned long long)num_tapes)
+                corrupted();
+            // it may stop in the middle of the sweep, and the rest is replayed by the next forward
+            sweep_tape = (int)tape;
+            sweep_rest = (long)get_signed(pos);
+            replay_sweep(sim, steps);
+            break;
+        }
+        case 'C':
+            read_snapshot(&sim, pos);
+            break;
+        case 'H': {
+            unsigned long long status = get_number(pos);
+            if (status > STATUS_LOOP)
+                corrupted();
+            sim.status = (status_t)status;
+            get_number(pos);
+            return false;
+        }
+        default:
+            return false;
+        }
+    }
+    return sim.steps == steps;
+}
@@ -0,0 +1,102 @@
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "compiled_machine.h"
+
+class Simulator;
+
+// A trace of a run is a binary file with one small record per step:
+//   header: TRACE_MAGIC, num_tapes, number of states, number of letters, snapshot distance
+//   'S' new_state action_1 ... action_k    - a single step (actions packed as in CompiledMachine)
+//   'W' tape distance                      - a sweep, i.e. |distance| steps which only move a head
+//   'C' steps state (head first length cells)^k - a snapshot of the whole configuration
+//   'H' status steps                       - the end of the run
+//   'I' count (steps offset)^count         - the index of snapshots, followed by its offset and INDEX_MAGIC
+// Numbers are LEB128 varints (signed ones zigzag-encoded), cells of snapshots are 16-bit little-endian.
+// Snapshots are written every given number of steps, so that any step can be
+// restored by replaying the records following the nearest earlier snapshot.
+
+#define TRACE_MAGIC "TMTRACE1"
+#define INDEX_MAGIC "TMTRIDX1"
+
+class TraceWriter {
+public:
+    TraceWriter(const std::string &filename, const CompiledMachine &cm, unsigned long long snapshot_distance_);
+    ~TraceWriter(); // writes the index of snapshots
+
+    void step(state_t new_state, const uint32_t *actions);
+    void sweep(int tape, long distance);
+    void snapshot(const Simulator &sim);
+    void halt(const Simulator &sim);
+
+    bool snapshot_due(unsigned long long steps) const {
+        return steps >= last_snapshot + snapshot_distance;
+    }
+
+private:
+    static const size_t BUFFER_SIZE = 1 << 20;
+
+    FILE *file;
+    int num_tapes;
+    unsigned long long snapshot_distance;
+    unsigned long long last_snapshot;
+    std::vector<std::pair<unsigned long long, unsigned long long>> index; // (steps, offset) of snapshots
+    unsigned long long written; // bytes flushed to the file
+    std::vector<unsigned char> buffer;
+
+    void put_byte(unsigned char byte) {
+        buffer.push_back(byte);
+    }
+    void put_number(unsigned long long value);
+    void put_signed(long long value);
+    void flush();
+};
+
+class TraceReader {
+public:
+    int num_tapes;
+    size_t num_states, num_letters;
+    unsigned long long snapshot_distance;
+
+    explicit TraceReader(const std::string &filename); // reports an invalid file by machine_error
+
+    TraceReader(const TraceReader &) = delete;
+    TraceReader &operator=(const TraceReader &) = delete;
+
+    // restores the configuration of the run after the given number of steps;
+    // returns false if the run ended earlier (sim then holds the last configuration)
+    bool seek(Simulator &sim, unsigned long long steps);
+
+    // continues replaying the run from the configuration restored by the last seek (or forward) to sim,
+    // which is faster than seeking the later step; returns false as seek
+    bool forward(Simulator &sim, unsigned long long steps);
+
+private:
+    // the memory-mapped file, which is unmapped also when the constructor fails
+    struct Mapping {
+        void *address = nullptr;
+        size_t size = 0;
+        ~Mapping();
+    } mapping;
+    const unsigned char *data;
+    size_t size; // of the records, without an incomplete last one
+    size_t start; // offset of the first record
+    std::vector<std::pair<unsigned long long, unsigned long long>> index;
+    size_t cursor; // offset of the record following the configuration restored last
+    int sweep_tape;
+    long sweep_rest; // the part of the sweep interrupted by the last seek which is not replayed yet
+
+    unsigned long long get_number(size_t &pos) const;
+    long long get_signed(size_t &pos) const;
+    // returns the step of the snapshot; restores it if sim is given
+    unsigned long long read_snapshot(Simulator *sim, size_t &pos) const;
+    bool complete_record(size_t pos) const;
+    void replay_sweep(Simulator &sim, unsigned long long steps);
+    [[noreturn]] void corrupted() const;
+};
+
+#endif
@@ -1,44 +1,91 @@
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
 #include <cstdio>
 #include <cstdlib>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <queue>
 #include <set>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "thread_pool.h"
 #include "turing_machine.h"
 
 using namespace std;
 
+// The text of a machine file: memory-mapped if it is a regular file, read into a buffer otherwise.
+class InputFile {
+public:
+    string_view text;
+
+    explicit InputFile(FILE *input_) : input(input_) {
+        assert(input);
+        struct stat file_stat;
+        int fd = fileno(input);
+        if (fd >= 0 && fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size > 0) {
+            void *address = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address != MAP_FAILED) {
+                mapped = address;
+                text = string_view((const char *)address, file_stat.st_size);
+                return;
+            }
+        }
+        char chunk[1 << 16];
+        size_t length;
+        while ((length = fread(chunk, 1, sizeof(chunk), input)) > 0)
+            buffer.append(chunk, length);
+        text = buffer;
+    }
+
+    ~InputFile() {
+        if (mapped)
+            munmap(mapped, text.size());
+        assert(fclose(input) == 0);
+    }
+
+    InputFile(const InputFile &) = delete;
+    InputFile &operator=(const InputFile &) = delete;
+
+private:
+    FILE *input;
+    void *mapped = nullptr;
+    string buffer;
+};
+
+// Splits a part of the text into tokens, without copying them.
 class Reader {
 public:
-    bool is_next_token_available() {
-        return next_char != '\n' && next_char != EOF;
+    bool is_next_token_available() const {
+        return pos < text.size() && text[pos] != '\n';
     }
     
-    string next_token() { // only in the current line
+    string_view next_token() { // only in the current line
         assert(is_next_token_available());
-        string res;
-        while (next_char != ' ' && next_char != '\t' && next_char != '\n' && next_char != EOF)
-            res += get_next_char();
+        size_t start = pos;
+        while (pos < text.size() && text[pos] != ' ' && text[pos] != '\t' && text[pos] != '\n' && text[pos] != '#')
+            ++pos;
+        string_view res = text.substr(start, pos - start);
         skip_spaces();
         return res;
     }
     
     void go_to_next_line() { // in particular skips empty lines
         assert(!is_next_token_available());
-        while (next_char == '\n') {
-            get_next_char();
+        while (pos < text.size() && text[pos] == '\n') {
+            ++pos;
+            ++line;
             skip_spaces();
         }
     }
     
-    ~Reader() {
-        assert(fclose(input) == 0);
-    }
-    
-    Reader(FILE *input_) : input(input_) {
-        assert(input);
-        get_next_char();
+    // the number of the first line of the text is first_line
+    Reader(string_view text_, int first_line = 1) : text(text_), line(first_line) {
         skip_spaces();
         if (!is_next_token_available())
             go_to_next_line();
@@ -48,25 +95,21 @@ public:
         return line;
     }
 
-private:
-    FILE *input;
-    int next_char; // we always have the next char here
-    int line = 1;
-    
-    int get_next_char() {
-        if (next_char == '\n')
-            ++line;
-        int prev = next_char;
-        next_char = fgetc(input);
-        if (next_char == '#') // skip a comment until EOL or EOF
-            while (next_char != '\n' && next_char != EOF)
-                next_char = fgetc(input);
-        return prev;
+    size_t get_pos() const {
+        return pos;
     }
+
+private:
+    string_view text;
+    size_t pos = 0;
+    int line;
     
     void skip_spaces() {
-        while (next_char == ' ' || next_char == '\t')
-            get_next_char();
+        while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t'))
+            ++pos;
+        if (pos < text.size() && text[pos] == '#') // skip a comment until EOL or EOF
+            while (pos < text.size() && text[pos] != '\n')
+                ++pos;
     }
 };
 
@@ -84,7 +127,7 @@ static bool is_direction(int ch) {
 // searches for an identifier starting from position pos;
 // at the end pos is the position after the identifier
 // (if false returned, pos remains unchanged)
-static bool check_identifier(string ident, size_t &pos) {
+static bool check_identifier(string_view ident, size_t &pos) {
     if (pos >= ident.size())
         return false;
     if (is_valid_char(ident[pos])) {
@@ -93,31 +136,48 @@ static bool check_identifier(string ident, size_t &pos) {
     }
     if (ident[pos] != '(')
         return false;
-    size_t pos2 = pos + 1;
-    while (check_identifier(ident, pos2));
-    if (pos2 == pos + 1 || pos2 >= ident.size() || ident[pos2] != ')')
-        return false;
-    pos = pos2 + 1;
+    // the brackets are balanced and every one of them holds a nonempty sequence of identifiers
+    size_t end = pos;
+    int depth = 0;
+    do {
+        if (end >= ident.size())
+            return false;
+        if (ident[end] == '(') {
+            if (end + 1 < ident.size() && ident[end + 1] == ')')
+                return false;
+            ++depth;
+        } else if (ident[end] == ')') {
+            --depth;
+        } else if (!is_valid_char(ident[end])) {
+            return false;
+        }
+        ++end;
+    } while (depth > 0);
+    pos = end;
     return true;
 }
 
-static bool is_identifier(string ident) {
+static bool is_identifier(string_view ident) {
     size_t pos = 0;
     return check_identifier(ident, pos) && pos == ident.length();
 }
 
+bool is_identifier(const string &name) {
+    return is_identifier(string_view(name));
+}
+
 TuringMachine::TuringMachine(int num_tapes_, vector<string> input_alphabet_, transitions_t transitions_)
-    : num_tapes(num_tapes_), input_alphabet(input_alphabet_), transitions(transitions_) {
+    : num_tapes(num_tapes_), input_alphabet(move(input_alphabet_)), transitions(move(transitions_)) {
     assert(num_tapes > 0);
     assert(!input_alphabet.empty());
     for (auto letter : input_alphabet)
         assert(is_identifier(letter) && letter != BLANK);
-    for (auto transition : transitions) {
-        auto state_before = transition.first.first;
-        auto letters_before = transition.first.second;
-        auto state_after = get<0>(transition.second);
-        auto letters_after = get<1>(transition.second);
-        auto directions = get<2>(transition.second);
+    for (const auto &transition : transitions) {
+        const auto &state_before = transition.first.first;
+        const auto &letters_before = transition.first.second;
+        const auto &state_after = get<0>(transition.second);
+        const auto &letters_after = get<1>(transition.second);
+        const auto &directions = get<2>(transition.second);
         assert(is_identifier(state_before) && state_before != ACCEPTING_STATE && state_before != REJECTING_STATE && is_identifier(state_after));
         assert(letters_before.size() == (size_t)num_tapes && letters_after.size() == (size_t)num_tapes && directions.length() == (size_t)num_tapes);
         for (int a = 0; a < num_tapes; ++a)
@@ -125,73 +185,56 @@ TuringMachine::TuringMachine(int num_tapes_, vector<string> input_alphabet_, tra
     }
 }
 
+// A syntax error in a line of a machine file, reported by read_tm_from_file.
+struct SyntaxError {
+    int line;
+    string message;
+};
+
 #define syntax_error(reader, message) \
     for(;;) { \
-        cerr << "Syntax error in line " << reader.get_line_num() << ": " << message << "\n"; \
-        exit(1); \
+        ostringstream error_message; \
+        error_message << message; \
+        throw SyntaxError{reader.get_line_num(), error_message.str()}; \
     }
 
 static string read_identifier(Reader &reader) {
     if (!reader.is_next_token_available())
         syntax_error(reader, "Identifier expected");
-    string ident = reader.next_token();
-    size_t pos = 0;
-    if (!check_identifier(ident, pos) || pos != ident.length())
+    string_view ident = reader.next_token();
+    if (!is_identifier(ident))
         syntax_error(reader, "Invalid identifier \"" << ident << "\"");
-    return ident;
+    return string(ident);
 }
 
 #define NUM_TAPES "num-tapes:"
 #define INPUT_ALPHABET "input-alphabet:"
 
-TuringMachine read_tm_from_file(FILE *input) {
-    Reader reader(input);
+// The transitions read from a part of the file, in the order of lines.
+struct TransitionChunk {
+    vector<pair<int, pair<transitions_t::key_type, transitions_t::mapped_type>>> transitions; // with the lines
+    bool failed = false;
+    SyntaxError error;
+    bool key_read = false; // whether the state and letters of the failed line were read
+    transitions_t::key_type key;
+    int lines = 0; // the number of line ends in the part
+};
 
-    // number of tapes
-    int num_tapes;
-    if (!reader.is_next_token_available() || reader.next_token() != NUM_TAPES)
-        syntax_error(reader, "\"" NUM_TAPES "\" expected");
-    try {
-        if (!reader.is_next_token_available())
-            throw 0;
-        string num_tapes_str = reader.next_token();
-        size_t last;
-        num_tapes = stoi(num_tapes_str, &last);
-        if (last != num_tapes_str.length() || num_tapes <= 0)
-            throw 0;
-    } catch (...) {
-        syntax_error(reader, "Positive integer expected after \"" NUM_TAPES "\"");
-    }
-    if (reader.is_next_token_available())
-        syntax_error(reader, "Too many tokens in a line");
-    reader.go_to_next_line();
-    
-    // input alphabet
-    vector<string> input_alphabet;
-    if (!reader.is_next_token_available() || reader.next_token() != INPUT_ALPHABET)
-        syntax_error(reader, "\"" INPUT_ALPHABET "\" expected");
-    while (reader.is_next_token_available()) {
-        input_alphabet.emplace_back(read_identifier(reader));
-        if (input_alphabet.back() == BLANK)
-            syntax_error(reader, "The blank letter \"" BLANK "\" is not allowed in the input alphabet");
-    }
-    if (input_alphabet.empty())
-        syntax_error(reader, "Identifier expected");
-    reader.go_to_next_line();
-    
-    // transitions
-    transitions_t transitions;
+// Reads the lines with transitions; the line numbers are counted from the start of the chunk.
+static void read_transitions(Reader &reader, int num_tapes, TransitionChunk &chunk) {
     while (reader.is_next_token_available()) {
-        string state_before = read_identifier(reader);
+        chunk.key_read = false;
+        chunk.key.first = read_identifier(reader);
+        const string &state_before = chunk.key.first;
         if (state_before == "(accept)" || state_before == "(reject)")
             syntax_error(reader, "No transition can start in the \"" << state_before << "\" state");
 
-        vector<string> letters_before;
+        vector<string> &letters_before = chunk.key.second;
+        letters_before.clear();
         for (int a = 0; a < num_tapes; ++a)
             letters_before.emplace_back(read_identifier(reader));
-
-        if (transitions.find(make_pair(state_before, letters_before)) != transitions.end())
-            syntax_error(reader, "The machine is not deterministic");
+        // whether the machine is deterministic is checked when the chunks are put together
+        chunk.key_read = true;
 
         string state_after = read_identifier(reader);
 
@@ -201,7 +244,7 @@ TuringMachine read_tm_from_file(FILE *input) {
 
         string directions;
         for (int a = 0; a < num_tapes; ++a) {
-            string dir;
+            string_view dir;
             if (!reader.is_next_token_available() || (dir = reader.next_token()).length() != 1 || !is_direction(dir[0]))
                 syntax_error(reader, "Move direction expected, which should be " << HEAD_LEFT << ", " << HEAD_RIGHT << ", or " << HEAD_STAY);
             directions += dir;
@@ -209,12 +252,127 @@ TuringMachine read_tm_from_file(FILE *input) {
         
         if (reader.is_next_token_available()) 
             syntax_error(reader, "Too many tokens in a line");
+        chunk.transitions.emplace_back(reader.get_line_num(),
+                                       make_pair(chunk.key, make_tuple(state_after, letters_after, directions)));
+        reader.go_to_next_line();
+    }
+}
+
+// parts of the file smaller than this are not read in parallel
+static const size_t MIN_CHUNK_SIZE = 1 << 20;
+
+TuringMachine read_tm_from_file(FILE *input) {
+    InputFile file(input);
+    try {
+        Reader reader(file.text);
+
+        // number of tapes
+        int num_tapes;
+        if (!reader.is_next_token_available() || reader.next_token() != NUM_TAPES)
+            syntax_error(reader, "\"" NUM_TAPES "\" expected");
+        try {
+            if (!reader.is_next_token_available())
+                throw 0;
+            string num_tapes_str(reader.next_token());
+            size_t last;
+            num_tapes = stoi(num_tapes_str, &last);
+            if (last != num_tapes_str.length() || num_tapes <= 0)
+                throw 0;
+        } catch (...) {
+            syntax_error(reader, "Positive integer expected after \"" NUM_TAPES "\"");
+        }
+        if (reader.is_next_token_available())
+            syntax_error(reader, "Too many tokens in a line");
+        reader.go_to_next_line();
+        
+        // input alphabet
+        vector<string> input_alphabet;
+        if (!reader.is_next_token_available() || reader.next_token() != INPUT_ALPHABET)
+            syntax_error(reader, "\"" INPUT_ALPHABET "\" expected");
+        while (reader.is_next_token_available()) {
+            input_alphabet.emplace_back(read_identifier(reader));
+            if (input_alphabet.back() == BLANK)
+                syntax_error(reader, "The blank letter \"" BLANK "\" is not allowed in the input alphabet");
+        }
+        if (input_alphabet.empty())
+            syntax_error(reader, "Identifier expected");
         reader.go_to_next_line();
         
-        transitions[make_pair(state_before, letters_before)] = make_tuple(state_after, letters_after, directions);
+        // transitions, read in parts which end with whole lines
+        string_view rest = file.text.substr(reader.get_pos());
+        unsigned num_threads = max(1u, thread::hardware_concurrency());
+        size_t num_chunks = min<size_t>(4 * num_threads, rest.size() / MIN_CHUNK_SIZE + 1);
+        vector<string_view> parts;
+        for (size_t a = 0, begin = 0; a < num_chunks && begin < rest.size(); ++a) {
+            size_t end = a + 1 == num_chunks ? rest.size() : max(begin, rest.size() * (a + 1) / num_chunks);
+            end = min(rest.find('\n', end), rest.size() - 1) + 1;
+            parts.push_back(rest.substr(begin, end - begin));
+            begin = end;
+        }
+        vector<TransitionChunk> chunks(parts.size());
+        parallel_for(parts.size(), num_threads, [&](unsigned, size_t a) {
+            Reader chunk_reader(parts[a], 0);
+            try {
+                read_transitions(chunk_reader, num_tapes, chunks[a]);
+            } catch (const SyntaxError &error) {
+                chunks[a].failed = true;
+                chunks[a].error = error;
+            }
+            chunks[a].lines = chunk_reader.get_line_num();
+        });
+
+        // Put together in the order of lines, so the first error in the file is reported.
+        transitions_t transitions;
+        int first_line = reader.get_line_num();
+        auto not_deterministic = [](int line) {
+            return SyntaxError{line, "The machine is not deterministic"};
+        };
+        for (auto &chunk : chunks) {
+            for (auto &transition : chunk.transitions) {
+                // the files are usually sorted, so the transition mostly goes to the end
+                if (transitions.empty() || prev(transitions.end())->first < transition.second.first)
+                    transitions.emplace_hint(transitions.end(), move(transition.second));
+                else if (!transitions.insert(move(transition.second)).second)
+                    throw not_deterministic(first_line + transition.first);
+            }
+            if (chunk.failed) {
+                if (chunk.key_read && transitions.count(chunk.key))
+                    throw not_deterministic(first_line + chunk.error.line);
+                chunk.error.line += first_line;
+                throw chunk.error;
+            }
+            first_line += chunk.lines;
+        }
+        
+        return TuringMachine(num_tapes, move(input_alphabet), move(transitions));
+    } catch (const SyntaxError &error) {
+        string message = "Syntax error in line " + to_string(error.line) + ": " + error.message;
+        if (MachineErrorScope::active())
+            throw MachineError{message};
+        cerr << message << "\n";
+        exit(1);
     }
-    
-    return TuringMachine(num_tapes, input_alphabet, transitions);
+}
+
+static thread_local int error_scopes = 0;
+
+MachineErrorScope::MachineErrorScope() {
+    ++error_scopes;
+}
+
+MachineErrorScope::~MachineErrorScope() {
+    --error_scopes;
+}
+
+bool MachineErrorScope::active() {
+    return error_scopes > 0;
+}
+
+void machine_error(const string &message) {
+    if (error_scopes)
+        throw MachineError{message};
+    cerr << "ERROR: " << message << "\n";
+    exit(1);
 }
 
 vector<string> TuringMachine::working_alphabet() const {
@@ -278,9 +436,9 @@ vector<string> TuringMachine::parse_input(std::string input) const {
     return res;
 }
 
-int NUMBER_OF_PARENTHESES = 0;
-
-void set_number_of_parentheses(vector<string> working_alphabet) {
+// The most parentheses in a letter of the alphabet; a name in more parentheses than that is not a letter of it.
+static int number_of_parentheses(const vector<string> &working_alphabet) {
+    int res = 0;
     for (auto letter: working_alphabet) {
         int paren = 0;
         for (auto c: letter) {
@@ -288,37 +446,35 @@ void set_number_of_parentheses(vector<string> working_alphabet) {
                 paren++;
             }
         }
-        if (paren > NUMBER_OF_PARENTHESES) {
-            NUMBER_OF_PARENTHESES = paren;
+        if (paren > res) {
+            res = paren;
         }
     }
+    return res;
+}
+
+// Puts the name in one more parentheses than a letter of the alphabet has.
+static string in_parentheses(const string &name, int parentheses) {
+    return string(parentheses + 1, '(') + name + string(parentheses + 1, ')');
 }
 
 // Makes letter with token which means that the logical head is above this letter.
-string make_logical_head(string letter) {
-    string res;
-    for (int i = 0; i <= NUMBER_OF_PARENTHESES; i++) {
-        res += "(";
-    }
-    res += letter + "-H";
-    for (int i = 0; i <= NUMBER_OF_PARENTHESES; i++) {
-        res += ")";
-    }
-    return res;
+string make_logical_head(const string &letter, int parentheses) {
+    return in_parentheses(letter + "-H", parentheses);
 }
 
 // Makes in transition for one tape machine.
-pair<string, vector<string>> make_in(string state, string letter) {
+pair<string, vector<string>> make_in(const string &state, const string &letter) {
     return make_pair(state, vector<string>{letter});
 }
 
 // Makes out transition for one tape machine.
-tuple<string, vector<string>, string> make_out(string state, string letter, char dir) {
+tuple<string, vector<string>, string> make_out(const string &state, const string &letter, char dir) {
     return make_tuple(state, vector<string>{letter}, string{dir});
 }
 
 // Makes state that comes from original state provided by user.
-string make_user_state(string original_state, string move, int tape) {
+string make_user_state(const string &original_state, const string &move, int tape) {
     return "(U-" + original_state + "-" + move + "-" + to_string(tape) + ")";
 }
 
@@ -328,36 +484,6 @@ const string INIT_PUT_END_OF_SECOND_HEAD = "(init-putEndOfSecondTape)";
 const string INIT_BACK_TO_BORDER = "(init-backToBorder)";
 const string INIT_BACK_TO_FRONT = "(init-backToFront)";
 
-string TAPE_BORDER;
-
-void set_tape_border() {
-    string res;
-    for (int i = 0; i <= NUMBER_OF_PARENTHESES; i++) {
-        res += "(";
-    }
-    res += "tape-border";
-    for (int i = 0; i <= NUMBER_OF_PARENTHESES; i++) {
-        res += ")";
-    }
-
-    TAPE_BORDER = res;
-}
-
-string TAPE_END;
-
-void set_tape_end() {
-    string res;
-    for (int i = 0; i <= NUMBER_OF_PARENTHESES; i++) {
-        res += "(";
-    }
-    res += "tape-end";
-    for (int i = 0; i <= NUMBER_OF_PARENTHESES; i++) {
-        res += ")";
-    }
-
-    TAPE_END = res;
-}
-
 
 const string MOVE_HEAD_RIGHT = "headRight";
 const string MOVE_HEAD_LEFT = "headLeft";
@@ -368,24 +494,75 @@ const string TO_SECOND_TAPE = "toSecondTape";
 const string EXT_TAPE_TAPE_BORDER = "extendTape-tapeBorder";
 const string EXT_TAPE_TAPE_END = "extendTape-tapeEnd";
 const string EXT_TAPE_MOVE_BACK = "extendTape-moveBack";
+const string EXT_TAPE_SKIP_PADDING = "extendTape-skipPadding";
 
-string extend_tape_with_letter(string letter) {
+string extend_tape_with_letter(const string &letter) {
     return "extendTape-" + letter;
 }
 
-string extend_tape_back_to_first_tape(string letter) {
+string extend_tape_back_to_first_tape(const string &letter) {
     return "backToFirstTape-" + letter;
 }
 
+bool is_tape_padding(const string &letter) {
+    size_t depth = 0;
+    while (depth < letter.length() / 2 && letter[depth] == '(' && letter[letter.length() - 1 - depth] == ')')
+        ++depth;
+    return depth > 0 && letter.compare(depth, letter.length() - 2 * depth, "tape-padding") == 0;
+}
+
+// The names used by the reduction, built once for every letter of the two-tape machine.
+// They depend only on the alphabet, so every reduction has its own and reductions do not affect each other.
+struct ReductionNames {
+    vector<string> alphabet; // working alphabet of the two-tape machine, letters are indices in it
+    int parentheses; // the most parentheses in a letter of the alphabet, the new letters have more
+    string tape_border, tape_end, tape_padding;
+    map<string, size_t> letter_ids;
+    vector<string> heads; // make_logical_head of every letter
+    vector<string> extend_letters, extend_heads, back_letters; // moves of the helper states for every letter
+    map<string, vector<string>> out_states; // state -> names of its user states for every pair of letters
+    size_t gap; // by how many cells the second tape is shifted when the first one grows
+    vector<size_t> letters1, letters2; // letters which can appear on the first and the second tape
+
+    explicit ReductionNames(const vector<string> &alphabet_, size_t gap_ = 1)
+        : alphabet(alphabet_), parentheses(number_of_parentheses(alphabet_)),
+          tape_border(in_parentheses("tape-border", parentheses)), tape_end(in_parentheses("tape-end", parentheses)),
+          tape_padding(in_parentheses("tape-padding", parentheses)), gap(gap_) {
+        for (size_t a = 0; a < alphabet.size(); ++a) {
+            letter_ids[alphabet[a]] = a;
+            letters1.push_back(a);
+            letters2.push_back(a);
+            heads.emplace_back(make_logical_head(alphabet[a], parentheses));
+            extend_letters.emplace_back(extend_tape_with_letter(alphabet[a]));
+            extend_heads.emplace_back(extend_tape_with_letter(heads[a]));
+            back_letters.emplace_back(extend_tape_back_to_first_tape(alphabet[a]));
+        }
+    }
+
+    // the user state of state_out with letter2 under the first head and letter1 under the second one,
+    // at index letter2 * alphabet.size() + letter1
+    const vector<string> &user_states_of(const string &state_out) {
+        auto it = out_states.find(state_out);
+        if (it != out_states.end())
+            return it->second;
+        vector<string> names;
+        for (auto letter2: alphabet)
+            for (auto letter1: alphabet)
+                names.emplace_back(make_user_state(state_out + "-(" + letter2 + ")-(" + letter1 + ")", "", 1));
+        return out_states[state_out] = names;
+    }
+};
+
 // Produce states that will split tape into two and place logical heads.
-transitions_t make_init_states(vector<string> &input_alphabet) {
+transitions_t make_init_states(const vector<string> &input_alphabet, const ReductionNames &names) {
     transitions_t res;
+    const auto &blank_head = names.heads[names.letter_ids.at(BLANK)];
 
     // Put logical head at the front of the tape and start finding second tape.
     for (auto letter: input_alphabet) {
-        res[make_in(INITIAL_STATE, letter)] = make_out(INIT_FIND_SECOND_TAPE, make_logical_head(letter), HEAD_RIGHT);
+        res[make_in(INITIAL_STATE, letter)] = make_out(INIT_FIND_SECOND_TAPE, names.heads[names.letter_ids.at(letter)], HEAD_RIGHT);
     }
-    res[make_in(INITIAL_STATE, BLANK)] = make_out(INIT_FIND_SECOND_TAPE, make_logical_head(BLANK), HEAD_RIGHT);
+    res[make_in(INITIAL_STATE, BLANK)] = make_out(INIT_FIND_SECOND_TAPE, blank_head, HEAD_RIGHT);
 
 
     // Find second tape.
@@ -394,15 +571,15 @@ transitions_t make_init_states(vector<string> &input_alphabet) {
     }
 
     // Put tape border, move right.
-    res[make_in(INIT_FIND_SECOND_TAPE, BLANK)] = make_out(INIT_PUT_SECOND_HEAD, TAPE_BORDER, HEAD_RIGHT);
+    res[make_in(INIT_FIND_SECOND_TAPE, BLANK)] = make_out(INIT_PUT_SECOND_HEAD, names.tape_border, HEAD_RIGHT);
     // Put logic head at the second tape, move right.
-    res[make_in(INIT_PUT_SECOND_HEAD, BLANK)] = make_out(INIT_PUT_END_OF_SECOND_HEAD, make_logical_head(BLANK), HEAD_RIGHT);
+    res[make_in(INIT_PUT_SECOND_HEAD, BLANK)] = make_out(INIT_PUT_END_OF_SECOND_HEAD, blank_head, HEAD_RIGHT);
     // Put tape end.
-    res[make_in(INIT_PUT_END_OF_SECOND_HEAD, BLANK)] = make_out(INIT_BACK_TO_BORDER, TAPE_END, HEAD_LEFT);
+    res[make_in(INIT_PUT_END_OF_SECOND_HEAD, BLANK)] = make_out(INIT_BACK_TO_BORDER, names.tape_end, HEAD_LEFT);
 
     // Back to front of the tape.
-    res[make_in(INIT_BACK_TO_BORDER, make_logical_head(BLANK))] = make_out(INIT_BACK_TO_BORDER, make_logical_head(BLANK), HEAD_LEFT);
-    res[make_in(INIT_BACK_TO_BORDER, TAPE_BORDER)] = make_out(INIT_BACK_TO_FRONT, TAPE_BORDER, HEAD_LEFT);
+    res[make_in(INIT_BACK_TO_BORDER, blank_head)] = make_out(INIT_BACK_TO_BORDER, blank_head, HEAD_LEFT);
+    res[make_in(INIT_BACK_TO_BORDER, names.tape_border)] = make_out(INIT_BACK_TO_FRONT, names.tape_border, HEAD_LEFT);
     for (auto letter: input_alphabet) {
         res[make_in(INIT_BACK_TO_FRONT, letter)] = make_out(INIT_BACK_TO_FRONT, letter, HEAD_LEFT);
     }
@@ -410,138 +587,1068 @@ transitions_t make_init_states(vector<string> &input_alphabet) {
     return res;
 }
 
-transitions_t make_one_tape_transitions_from_two(std::pair<std::string, std::vector<std::string>> in, std::tuple<std::string, std::vector<std::string>, std::string> out, vector<string> alphabet) {
-    auto letter_in_tape_1 = in.second[0];
-    auto letter_in_tape_2 = in.second[1];
-    auto letter_out_tape_1 = get<1>(out)[0];
-    auto letter_out_tape_2 = get<1>(out)[1];
+// The helper states of a single source transition.
+struct UserStates {
+    string state_in, start, left1, right1, to_second1, to_second2, border1, end1, move_back1, skip_padding1, left2, right2, end2;
+    vector<string> extend_letters, extend_heads, back2, back1; // for every letter
+
+    UserStates(const string &state_in_, const ReductionNames &names)
+        : state_in(state_in_), start(make_user_state(state_in, "", 1)),
+          left1(make_user_state(state_in, MOVE_HEAD_LEFT, 1)),
+          right1(make_user_state(state_in, MOVE_HEAD_RIGHT, 1)),
+          to_second1(make_user_state(state_in, TO_SECOND_TAPE, 1)),
+          to_second2(make_user_state(state_in, TO_SECOND_TAPE, 2)),
+          border1(make_user_state(state_in, EXT_TAPE_TAPE_BORDER, 1)),
+          end1(make_user_state(state_in, EXT_TAPE_TAPE_END, 1)),
+          move_back1(make_user_state(state_in, EXT_TAPE_MOVE_BACK, 1)),
+          skip_padding1(make_user_state(state_in, EXT_TAPE_SKIP_PADDING, 1)),
+          left2(make_user_state(state_in, MOVE_HEAD_LEFT, 2)),
+          right2(make_user_state(state_in, MOVE_HEAD_RIGHT, 2)),
+          end2(make_user_state(state_in, EXT_TAPE_TAPE_END, 2)) {
+        for (size_t a = 0; a < names.alphabet.size(); ++a) {
+            extend_letters.emplace_back(make_user_state(state_in, names.extend_letters[a], 1));
+            extend_heads.emplace_back(make_user_state(state_in, names.extend_heads[a], 1));
+            back2.emplace_back(make_user_state(state_in, names.back_letters[a], 2));
+            back1.emplace_back(make_user_state(state_in, names.back_letters[a], 1));
+        }
+    }
+};
+
+// Shifts the second tape right by names.gap cells at once, starting with the physical head at its first cell.
+// The state holds the cells still to be written, the first ones are the padding and the tape border.
+// The padding cells become cells of the first tape when its head gets there, without another shift.
+static void make_gap_shift(const UserStates &user, const ReductionNames &names, transitions_t &res) {
+    vector<string> cells;
+    for (auto letter: names.letters2)
+        cells.push_back(names.heads[letter]);
+    for (auto letter: names.letters2)
+        cells.push_back(names.alphabet[letter]);
+    auto state_of = [&](const vector<string> &pending) {
+        string name;
+        for (const auto &cell: pending)
+            name += "(" + cell + ")";
+        return make_user_state(user.state_in, extend_tape_with_letter(name), 1);
+    };
+
+    vector<string> first(names.gap - 1, names.tape_padding);
+    first.push_back(names.tape_border);
+    set<vector<string>> seen = {first};
+    vector<vector<string>> todo = {first};
+    while (!todo.empty()) {
+        auto pending = todo.back();
+        todo.pop_back();
+        auto state = pending == first ? user.border1 : state_of(pending);
+        vector<string> rest(pending.begin() + 1, pending.end());
+        if (pending.back() == names.tape_end) {
+            // Only blank cells are left to the right.
+            if (pending.size() == 1) {
+                res[make_in(state, BLANK)] = make_out(user.move_back1, names.tape_end, HEAD_LEFT);
+                continue;
+            }
+            res[make_in(state, BLANK)] = make_out(state_of(rest), pending[0], HEAD_RIGHT);
+            if (seen.insert(rest).second)
+                todo.push_back(rest);
+            continue;
+        }
+        rest.push_back(names.tape_end);
+        for (size_t a = 0; a <= cells.size(); ++a) {
+            const auto &cell = a < cells.size() ? cells[a] : names.tape_end;
+            rest.back() = cell;
+            res[make_in(state, cell)] = make_out(state_of(rest), pending[0], HEAD_RIGHT);
+            if (seen.insert(rest).second)
+                todo.push_back(rest);
+        }
+    }
+}
+
+// Moves over the padding between the tapes, which is the blank part of the first tape.
+static void make_padding_transitions(const UserStates &user, const ReductionNames &names, bool right1, transitions_t &res) {
+    const auto &blank_head = names.heads[names.letter_ids.at(BLANK)];
+    res[make_in(user.to_second1, names.tape_padding)] = make_out(user.to_second1, names.tape_padding, HEAD_RIGHT);
+    for (const auto &back1: user.back1)
+        res[make_in(back1, names.tape_padding)] = make_out(back1, names.tape_padding, HEAD_LEFT);
+    if (!right1)
+        return;
+    res[make_in(user.right1, names.tape_padding)] = make_out(user.to_second1, blank_head, HEAD_RIGHT);
+    // After a shift the first head goes to the new cell before the padding.
+    res[make_in(user.skip_padding1, names.tape_padding)] = make_out(user.skip_padding1, names.tape_padding, HEAD_LEFT);
+    res[make_in(user.skip_padding1, BLANK)] = make_out(user.to_second1, blank_head, HEAD_RIGHT);
+}
+
+// Adds the transitions of the one-tape machine simulating a single transition of the two-tape machine.
+void make_one_tape_transitions_from_two(const std::pair<std::string, std::vector<std::string>> &in, const std::tuple<std::string, std::vector<std::string>, std::string> &out, ReductionNames &names, transitions_t &res) {
+    const auto &alphabet = names.alphabet;
+    const auto &heads = names.heads;
+    size_t n = alphabet.size();
+    auto letter_in_tape_1 = names.letter_ids.at(in.second[0]);
+    auto letter_in_tape_2 = names.letter_ids.at(in.second[1]);
+    auto letter_out_tape_1 = names.letter_ids.at(get<1>(out)[0]);
+    auto letter_out_tape_2 = names.letter_ids.at(get<1>(out)[1]);
     auto dir_tape_1 = get<2>(out)[0];
     auto dir_tape_2 = get<2>(out)[1];
 
     // Save information about input and output letters in state.
-    auto state_in = in.first + "-(" + letter_in_tape_1 + ")-(" + letter_in_tape_2 + ")";
-
-    transitions_t res;
+    UserStates user(in.first + "-(" + alphabet[letter_in_tape_1] + ")-(" + alphabet[letter_in_tape_2] + ")", names);
 
     // Add transition from internal initial state to user-defined start state.
     if (in.first == INITIAL_STATE) {
         // Second tape is always empty on the start.
-        if (letter_in_tape_2 == BLANK) {
-            res[make_in(INIT_BACK_TO_FRONT, make_logical_head(letter_in_tape_1))] = make_out(make_user_state(state_in, "", 1), make_logical_head(letter_in_tape_1), HEAD_STAY);
+        if (alphabet[letter_in_tape_2] == BLANK) {
+            res[make_in(INIT_BACK_TO_FRONT, heads[letter_in_tape_1])] = make_out(user.start, heads[letter_in_tape_1], HEAD_STAY);
         }
     }
 
     if (dir_tape_1 == HEAD_LEFT) {
-        res[make_in(make_user_state(state_in, "", 1), make_logical_head(letter_in_tape_1))] = make_out(make_user_state(state_in, MOVE_HEAD_LEFT, 1), letter_out_tape_1, HEAD_LEFT);
-        for (auto letter: alphabet) {
-            res[make_in(make_user_state(state_in, MOVE_HEAD_LEFT, 1), letter)] = make_out(make_user_state(state_in, TO_SECOND_TAPE, 1), make_logical_head(letter), HEAD_RIGHT);
+        res[make_in(user.start, heads[letter_in_tape_1])] = make_out(user.left1, alphabet[letter_out_tape_1], HEAD_LEFT);
+        for (auto letter: names.letters1) {
+            res[make_in(user.left1, alphabet[letter])] = make_out(user.to_second1, heads[letter], HEAD_RIGHT);
         }
     }
 
     if (dir_tape_1 == HEAD_RIGHT) {
-        res[make_in(make_user_state(state_in, "", 1), make_logical_head(letter_in_tape_1))] = make_out(make_user_state(state_in, MOVE_HEAD_RIGHT, 1), letter_out_tape_1, HEAD_RIGHT);
-        for (auto letter: alphabet) {
-            res[make_in(make_user_state(state_in, MOVE_HEAD_RIGHT, 1), letter)] = make_out(make_user_state(state_in, TO_SECOND_TAPE, 1), make_logical_head(letter), HEAD_RIGHT);
+        res[make_in(user.start, heads[letter_in_tape_1])] = make_out(user.right1, alphabet[letter_out_tape_1], HEAD_RIGHT);
+        for (auto letter: names.letters1) {
+            res[make_in(user.right1, alphabet[letter])] = make_out(user.to_second1, heads[letter], HEAD_RIGHT);
         }
 
         // Extend first tape if necessary.
-        res[make_in(make_user_state(state_in, MOVE_HEAD_RIGHT, 1), TAPE_BORDER)] = make_out(make_user_state(state_in, EXT_TAPE_TAPE_BORDER, 1), BLANK, HEAD_RIGHT);
-        for (auto letter1: alphabet) {
-            res[make_in(make_user_state(state_in, EXT_TAPE_TAPE_BORDER, 1), letter1)] = make_out(make_user_state(state_in, extend_tape_with_letter(letter1), 1), TAPE_BORDER, HEAD_RIGHT);
-            res[make_in(make_user_state(state_in, EXT_TAPE_TAPE_BORDER, 1), make_logical_head(letter1))] = make_out(make_user_state(state_in, extend_tape_with_letter(make_logical_head(letter1)), 1), TAPE_BORDER, HEAD_RIGHT);
-            for (auto letter2: alphabet) {
-                res[make_in(make_user_state(state_in, extend_tape_with_letter(letter1), 1), letter2)] = make_out(make_user_state(state_in, extend_tape_with_letter(letter2), 1), letter1, HEAD_RIGHT);
-                res[make_in(make_user_state(state_in, extend_tape_with_letter(letter1), 1), make_logical_head(letter2))] = make_out(make_user_state(state_in, extend_tape_with_letter(make_logical_head(letter2)), 1), letter1, HEAD_RIGHT);
-                res[make_in(make_user_state(state_in, extend_tape_with_letter(make_logical_head(letter1)), 1), letter2)] = make_out(make_user_state(state_in, extend_tape_with_letter(letter2), 1), make_logical_head(letter1), HEAD_RIGHT);
+        res[make_in(user.right1, names.tape_border)] = make_out(user.border1, BLANK, HEAD_RIGHT);
+        if (names.gap == 1) {
+            for (auto letter1: names.letters2) {
+                res[make_in(user.border1, alphabet[letter1])] = make_out(user.extend_letters[letter1], names.tape_border, HEAD_RIGHT);
+                res[make_in(user.border1, heads[letter1])] = make_out(user.extend_heads[letter1], names.tape_border, HEAD_RIGHT);
+                for (auto letter2: names.letters2) {
+                    res[make_in(user.extend_letters[letter1], alphabet[letter2])] = make_out(user.extend_letters[letter2], alphabet[letter1], HEAD_RIGHT);
+                    res[make_in(user.extend_letters[letter1], heads[letter2])] = make_out(user.extend_heads[letter2], alphabet[letter1], HEAD_RIGHT);
+                    res[make_in(user.extend_heads[letter1], alphabet[letter2])] = make_out(user.extend_letters[letter2], heads[letter1], HEAD_RIGHT);
+                }
+                res[make_in(user.extend_letters[letter1], names.tape_end)] = make_out(user.end1, alphabet[letter1], HEAD_RIGHT);
+                res[make_in(user.extend_heads[letter1], names.tape_end)] = make_out(user.end1, heads[letter1], HEAD_RIGHT);
             }
-            res[make_in(make_user_state(state_in, extend_tape_with_letter(letter1), 1), TAPE_END)] = make_out(make_user_state(state_in, EXT_TAPE_TAPE_END, 1), letter1, HEAD_RIGHT);
-            res[make_in(make_user_state(state_in, extend_tape_with_letter(make_logical_head(letter1)), 1), TAPE_END)] = make_out(make_user_state(state_in, EXT_TAPE_TAPE_END, 1), make_logical_head(letter1), HEAD_RIGHT);
+            res[make_in(user.end1, BLANK)] = make_out(user.move_back1, names.tape_end, HEAD_LEFT);
+        } else {
+            make_gap_shift(user, names, res);
         }
 
         // Back to moving logical head to the right.
-        res[make_in(make_user_state(state_in, EXT_TAPE_TAPE_END, 1), BLANK)] = make_out(make_user_state(state_in, EXT_TAPE_MOVE_BACK, 1), TAPE_END, HEAD_LEFT);
-        for (auto letter: alphabet) {
-            res[make_in(make_user_state(state_in, EXT_TAPE_MOVE_BACK, 1), letter)] = make_out(make_user_state(state_in, EXT_TAPE_MOVE_BACK, 1), letter, HEAD_LEFT);
-            res[make_in(make_user_state(state_in, EXT_TAPE_MOVE_BACK, 1), make_logical_head(letter))] = make_out(make_user_state(state_in, EXT_TAPE_MOVE_BACK, 1), make_logical_head(letter), HEAD_LEFT);
+        for (auto letter: names.letters2) {
+            res[make_in(user.move_back1, alphabet[letter])] = make_out(user.move_back1, alphabet[letter], HEAD_LEFT);
+            res[make_in(user.move_back1, heads[letter])] = make_out(user.move_back1, heads[letter], HEAD_LEFT);
         }
-        res[make_in(make_user_state(state_in, EXT_TAPE_MOVE_BACK, 1), TAPE_BORDER)] = make_out(make_user_state(state_in, MOVE_HEAD_RIGHT, 1), TAPE_BORDER, HEAD_LEFT);
+        res[make_in(user.move_back1, names.tape_border)] = make_out(names.gap == 1 ? user.right1 : user.skip_padding1, names.tape_border, HEAD_LEFT);
     }
 
     if (dir_tape_1 == HEAD_STAY) {
-        res[make_in(make_user_state(state_in, "", 1), make_logical_head(letter_in_tape_1))] = make_out(make_user_state(state_in, TO_SECOND_TAPE, 1), make_logical_head(letter_out_tape_1), HEAD_RIGHT);
+        res[make_in(user.start, heads[letter_in_tape_1])] = make_out(user.to_second1, heads[letter_out_tape_1], HEAD_RIGHT);
     }
 
-    // Move physical head to the logical head on the second tape.
-    for (auto letter: alphabet) {
-        res[make_in(make_user_state(state_in, TO_SECOND_TAPE, 1), letter)] = make_out(make_user_state(state_in, TO_SECOND_TAPE, 1), letter, HEAD_RIGHT);
-        res[make_in(make_user_state(state_in, TO_SECOND_TAPE, 1), TAPE_BORDER)] = make_out(make_user_state(state_in, TO_SECOND_TAPE, 2), TAPE_BORDER, HEAD_RIGHT);
-        res[make_in(make_user_state(state_in, TO_SECOND_TAPE, 2), letter)] = make_out(make_user_state(state_in, TO_SECOND_TAPE, 2), letter, HEAD_RIGHT);
+    if (names.gap > 1) {
+        make_padding_transitions(user, names, dir_tape_1 == HEAD_RIGHT, res);
     }
 
+    // Move physical head to the logical head on the second tape.
+    for (auto letter: names.letters1)
+        res[make_in(user.to_second1, alphabet[letter])] = make_out(user.to_second1, alphabet[letter], HEAD_RIGHT);
+    for (auto letter: names.letters2)
+        res[make_in(user.to_second2, alphabet[letter])] = make_out(user.to_second2, alphabet[letter], HEAD_RIGHT);
+    res[make_in(user.to_second1, names.tape_border)] = make_out(user.to_second2, names.tape_border, HEAD_RIGHT);
+
     if (dir_tape_2 == HEAD_LEFT) {
-        res[make_in(make_user_state(state_in, TO_SECOND_TAPE, 2), make_logical_head(letter_in_tape_2))] = make_out(make_user_state(state_in, MOVE_HEAD_LEFT, 2), letter_out_tape_2, HEAD_LEFT);
-        for (auto letter: alphabet) {
-            res[make_in(make_user_state(state_in, MOVE_HEAD_LEFT, 2), letter)] = make_out(make_user_state(state_in, extend_tape_back_to_first_tape(letter), 2), make_logical_head(letter), HEAD_LEFT);
+        res[make_in(user.to_second2, heads[letter_in_tape_2])] = make_out(user.left2, alphabet[letter_out_tape_2], HEAD_LEFT);
+        for (auto letter: names.letters2) {
+            res[make_in(user.left2, alphabet[letter])] = make_out(user.back2[letter], heads[letter], HEAD_LEFT);
         }
     }
 
     if (dir_tape_2 == HEAD_RIGHT) {
-        res[make_in(make_user_state(state_in, TO_SECOND_TAPE, 2), make_logical_head(letter_in_tape_2))] = make_out(make_user_state(state_in, MOVE_HEAD_RIGHT, 2), letter_out_tape_2, HEAD_RIGHT);
-        for (auto letter: alphabet) {
-            res[make_in(make_user_state(state_in, MOVE_HEAD_RIGHT, 2), letter)] = make_out(make_user_state(state_in, extend_tape_back_to_first_tape(letter), 2), make_logical_head(letter), HEAD_LEFT);
+        res[make_in(user.to_second2, heads[letter_in_tape_2])] = make_out(user.right2, alphabet[letter_out_tape_2], HEAD_RIGHT);
+        for (auto letter: names.letters2) {
+            res[make_in(user.right2, alphabet[letter])] = make_out(user.back2[letter], heads[letter], HEAD_LEFT);
         }
 
         // Extend second tape if necessary.
-        res[make_in(make_user_state(state_in, MOVE_HEAD_RIGHT, 2), TAPE_END)] = make_out(make_user_state(state_in, EXT_TAPE_TAPE_END, 2), BLANK, HEAD_RIGHT);
+        res[make_in(user.right2, names.tape_end)] = make_out(user.end2, BLANK, HEAD_RIGHT);
         // Back to moving logical head to the right.
-        res[make_in(make_user_state(state_in, EXT_TAPE_TAPE_END, 2), BLANK)] = make_out(make_user_state(state_in, MOVE_HEAD_RIGHT, 2), TAPE_END, HEAD_LEFT);
+        res[make_in(user.end2, BLANK)] = make_out(user.right2, names.tape_end, HEAD_LEFT);
     }
 
     if (dir_tape_2 == HEAD_STAY) {
-        res[make_in(make_user_state(state_in, TO_SECOND_TAPE, 2), make_logical_head(letter_in_tape_2))] = make_out(make_user_state(state_in, extend_tape_back_to_first_tape(letter_out_tape_2), 2), make_logical_head(letter_out_tape_2), HEAD_LEFT);
+        res[make_in(user.to_second2, heads[letter_in_tape_2])] = make_out(user.back2[letter_out_tape_2], heads[letter_out_tape_2], HEAD_LEFT);
     }
 
     // Move physical head back to the logical head on the first tape.
-    for (auto letter1: alphabet) {
-        for (auto letter2: alphabet) {
-            res[make_in(make_user_state(state_in, extend_tape_back_to_first_tape(letter1), 2), letter2)] = make_out(make_user_state(state_in, extend_tape_back_to_first_tape(letter1), 2), letter2, HEAD_LEFT);
-            res[make_in(make_user_state(state_in, extend_tape_back_to_first_tape(letter1), 2), TAPE_BORDER)] = make_out(make_user_state(state_in, extend_tape_back_to_first_tape(letter1), 1), TAPE_BORDER, HEAD_LEFT);
-            res[make_in(make_user_state(state_in, extend_tape_back_to_first_tape(letter1), 1), letter2)] = make_out(make_user_state(state_in, extend_tape_back_to_first_tape(letter1), 1), letter2, HEAD_LEFT);
-        }
+    for (auto letter1: names.letters2) {
+        for (auto letter2: names.letters2)
+            res[make_in(user.back2[letter1], alphabet[letter2])] = make_out(user.back2[letter1], alphabet[letter2], HEAD_LEFT);
+        for (auto letter2: names.letters1)
+            res[make_in(user.back1[letter1], alphabet[letter2])] = make_out(user.back1[letter1], alphabet[letter2], HEAD_LEFT);
+        res[make_in(user.back2[letter1], names.tape_border)] = make_out(user.back1[letter1], names.tape_border, HEAD_LEFT);
     }
 
     // Add Out state, which connects different states.
-    for (auto letter1: alphabet) {
-        for (auto letter2: alphabet) {
-            // Notice that it is not necessary to check for REJECTING_STATE here, as there are simply no transitions starting from REJECT_STATE, so it will be automatically rejected.
-            if (get<0>(out) == ACCEPTING_STATE) {
-                res[make_in(make_user_state(state_in, extend_tape_back_to_first_tape(letter1), 1), make_logical_head(letter2))] = make_out(ACCEPTING_STATE, make_logical_head(letter2), HEAD_STAY);
+    // Notice that it is not necessary to check for REJECTING_STATE here, as there are simply no transitions starting from REJECT_STATE, so it will be automatically rejected.
+    const string &state_out = get<0>(out);
+    const vector<string> *out_states = state_out == ACCEPTING_STATE ? nullptr : &names.user_states_of(state_out);
+    for (auto letter1: names.letters2) {
+        for (auto letter2: names.letters1) {
+            res[make_in(user.back1[letter1], heads[letter2])] = make_out(out_states ? (*out_states)[letter2 * n + letter1] : ACCEPTING_STATE, heads[letter2], HEAD_STAY);
+        }
+    }
+}
+
+// Names of directions, which can be a part of an identifier.
+string direction_name(char dir) {
+    return dir == HEAD_LEFT ? "L" : dir == HEAD_RIGHT ? "R" : "S";
+}
+
+// Where the helper states go when the second head is placed on a letter:
+// back to the first head, or straight to the end if the new state halts.
+tuple<string, vector<string>, string> make_second_head_placed(const string &state_out, size_t letter, const ReductionNames &names) {
+    if (state_out == ACCEPTING_STATE || state_out == REJECTING_STATE)
+        return make_out(state_out, names.heads[letter], HEAD_STAY);
+    return make_out(make_user_state(state_out, names.back_letters[letter], 2), names.heads[letter], HEAD_LEFT);
+}
+
+// Produces transitions of the reduction in which the helper states are shared by all source transitions.
+// The helper states carry only what is still pending:
+// * until the second head is reached - the letter under it, what to write there, the move and the new state,
+// * after that - the new state only (and the letter under the second head on the way back).
+// When the first head moves onto the tape border, the border is overwritten with the new cell
+// and it is put back (shifting the second tape right) on the way back to the first head,
+// where the helper states know only the new state.
+void make_shared_one_tape_transitions(const transitions_t &transitions, ReductionNames &names, transitions_t &res) {
+    const auto &alphabet = names.alphabet;
+    const auto &heads = names.heads;
+    size_t n = alphabet.size();
+    set<string> states_out;
+
+    for (const auto &transition: transitions) {
+        const auto &in = transition.first;
+        const auto &out = transition.second;
+        auto letter_in_tape_1 = names.letter_ids.at(in.second[0]);
+        auto letter_in_tape_2 = names.letter_ids.at(in.second[1]);
+        auto letter_out_tape_1 = names.letter_ids.at(get<1>(out)[0]);
+        auto letter_out_tape_2 = names.letter_ids.at(get<1>(out)[1]);
+        auto dir_tape_1 = get<2>(out)[0];
+        auto dir_tape_2 = get<2>(out)[1];
+        const auto &state_out = get<0>(out);
+
+        auto start = make_user_state(in.first + "-(" + alphabet[letter_in_tape_1] + ")-(" + alphabet[letter_in_tape_2] + ")", "", 1);
+        // Everything that is left to do on the second tape.
+        auto pending = state_out + "-(" + alphabet[letter_in_tape_2] + ")-(" + alphabet[letter_out_tape_2] + ")-(" + direction_name(dir_tape_2) + ")";
+        auto to_second = make_user_state(pending, TO_SECOND_TAPE, 1);
+        if (state_out != ACCEPTING_STATE && state_out != REJECTING_STATE)
+            states_out.insert(state_out);
+
+        // Add transition from internal initial state to user-defined start state.
+        if (in.first == INITIAL_STATE && alphabet[letter_in_tape_2] == BLANK) {
+            res[make_in(INIT_BACK_TO_FRONT, heads[letter_in_tape_1])] = make_out(start, heads[letter_in_tape_1], HEAD_STAY);
+        }
+
+        // Move the first head.
+        if (dir_tape_1 == HEAD_LEFT) {
+            auto left = make_user_state(pending, MOVE_HEAD_LEFT, 1);
+            res[make_in(start, heads[letter_in_tape_1])] = make_out(left, alphabet[letter_out_tape_1], HEAD_LEFT);
+            for (size_t letter = 0; letter < n; ++letter) {
+                res[make_in(left, alphabet[letter])] = make_out(to_second, heads[letter], HEAD_RIGHT);
+            }
+        }
+        if (dir_tape_1 == HEAD_RIGHT) {
+            auto right = make_user_state(pending, MOVE_HEAD_RIGHT, 1);
+            res[make_in(start, heads[letter_in_tape_1])] = make_out(right, alphabet[letter_out_tape_1], HEAD_RIGHT);
+            for (size_t letter = 0; letter < n; ++letter) {
+                res[make_in(right, alphabet[letter])] = make_out(to_second, heads[letter], HEAD_RIGHT);
+            }
+            // The new cell of the first tape takes the place of the tape border for now.
+            res[make_in(right, names.tape_border)] = make_out(to_second, make_logical_head(BLANK, names.parentheses), HEAD_RIGHT);
+        }
+        if (dir_tape_1 == HEAD_STAY) {
+            res[make_in(start, heads[letter_in_tape_1])] = make_out(to_second, heads[letter_out_tape_1], HEAD_RIGHT);
+        }
+
+        // Move physical head to the logical head on the second tape (the tape border may be missing).
+        for (size_t letter = 0; letter < n; ++letter) {
+            res[make_in(to_second, alphabet[letter])] = make_out(to_second, alphabet[letter], HEAD_RIGHT);
+        }
+        res[make_in(to_second, names.tape_border)] = make_out(to_second, names.tape_border, HEAD_RIGHT);
+
+        // Move the second head, from now on only the new state is pending.
+        auto left2 = make_user_state(state_out, MOVE_HEAD_LEFT, 2);
+        auto right2 = make_user_state(state_out, MOVE_HEAD_RIGHT, 2);
+        auto end2 = make_user_state(state_out, EXT_TAPE_TAPE_END, 2);
+        auto second_head = make_in(to_second, heads[letter_in_tape_2]);
+        if (dir_tape_2 == HEAD_LEFT)
+            res[second_head] = make_out(left2, alphabet[letter_out_tape_2], HEAD_LEFT);
+        if (dir_tape_2 == HEAD_RIGHT)
+            res[second_head] = make_out(right2, alphabet[letter_out_tape_2], HEAD_RIGHT);
+        if (dir_tape_2 == HEAD_STAY)
+            res[second_head] = make_second_head_placed(state_out, letter_out_tape_2, names);
+
+        for (size_t letter = 0; letter < n; ++letter) {
+            auto placed = make_second_head_placed(state_out, letter, names);
+            res[make_in(left2, alphabet[letter])] = placed;
+            res[make_in(right2, alphabet[letter])] = placed;
+        }
+        // Extend second tape if necessary.
+        res[make_in(right2, names.tape_end)] = make_out(end2, BLANK, HEAD_RIGHT);
+        res[make_in(end2, BLANK)] = make_out(right2, names.tape_end, HEAD_LEFT);
+    }
+
+    for (const auto &state_out: states_out) {
+        const auto &out_states = names.user_states_of(state_out);
+        auto border = make_user_state(state_out, EXT_TAPE_TAPE_BORDER, 1);
+        auto end1 = make_user_state(state_out, EXT_TAPE_TAPE_END, 1);
+        auto move_back = make_user_state(state_out, EXT_TAPE_MOVE_BACK, 1);
+        vector<string> back2, back1;
+        for (size_t letter = 0; letter < n; ++letter) {
+            back2.emplace_back(make_user_state(state_out, names.back_letters[letter], 2));
+            back1.emplace_back(make_user_state(state_out, names.back_letters[letter], 1));
+        }
+
+        // Move physical head back to the logical head on the first tape.
+        for (size_t letter1 = 0; letter1 < n; ++letter1) {
+            for (size_t letter2 = 0; letter2 < n; ++letter2) {
+                res[make_in(back2[letter1], alphabet[letter2])] = make_out(back2[letter1], alphabet[letter2], HEAD_LEFT);
+                res[make_in(back1[letter1], alphabet[letter2])] = make_out(back1[letter1], alphabet[letter2], HEAD_LEFT);
+                // Out state, which connects different states.
+                res[make_in(back1[letter1], heads[letter2])] = make_out(out_states[letter2 * n + letter1], heads[letter2], HEAD_STAY);
+                // The first head is reached without passing the tape border, so it has to be put back.
+                res[make_in(back2[letter1], heads[letter2])] = make_out(border, heads[letter2], HEAD_RIGHT);
+            }
+            res[make_in(back2[letter1], names.tape_border)] = make_out(back1[letter1], names.tape_border, HEAD_LEFT);
+        }
+
+        // Shift the second tape right by one cell, putting the tape border before it.
+        vector<string> cells, extend;
+        for (size_t letter = 0; letter < n; ++letter) {
+            cells.emplace_back(alphabet[letter]);
+            extend.emplace_back(make_user_state(state_out, names.extend_letters[letter], 1));
+            cells.emplace_back(heads[letter]);
+            extend.emplace_back(make_user_state(state_out, names.extend_heads[letter], 1));
+        }
+        for (size_t letter = 0; letter < cells.size(); ++letter) {
+            res[make_in(border, cells[letter])] = make_out(extend[letter], names.tape_border, HEAD_RIGHT);
+            for (size_t next_letter = 0; next_letter < cells.size(); ++next_letter) {
+                res[make_in(extend[letter], cells[next_letter])] = make_out(extend[next_letter], cells[letter], HEAD_RIGHT);
+            }
+            res[make_in(extend[letter], names.tape_end)] = make_out(end1, cells[letter], HEAD_RIGHT);
+        }
+        res[make_in(end1, BLANK)] = make_out(move_back, names.tape_end, HEAD_LEFT);
+
+        // Find the second head again, to go back to the first one.
+        for (size_t letter = 0; letter < n; ++letter) {
+            res[make_in(move_back, alphabet[letter])] = make_out(move_back, alphabet[letter], HEAD_LEFT);
+            res[make_in(move_back, heads[letter])] = make_out(back2[letter], heads[letter], HEAD_LEFT);
+        }
+    }
+}
+
+// The layout with two tracks: every cell holds a letter of each tape and marks of the heads above them.
+// A cell with no marks and a blank on the second track is the letter of the first track itself,
+// so the input needs no preparation and the blank is the blank of both tracks.
+static string make_track_letter(const ReductionNames &names, const string &letter1, bool head1, const string &letter2, bool head2) {
+    if (!head1 && !head2 && letter2 == BLANK)
+        return letter1;
+    return in_parentheses(letter1 + "-" + letter2 + "-" + (head1 ? "H" : "-") + (head2 ? "H" : "-"), names.parentheses);
+}
+
+static char opposite(char dir) {
+    return dir == HEAD_LEFT ? HEAD_RIGHT : HEAD_LEFT;
+}
+
+static string side_name(char dir) {
+    return dir == HEAD_LEFT ? "Left" : "Right";
+}
+
+// The physical head is at the first head and state waits for the next step;
+// the second head is on the given side, or at the same cell (HEAD_STAY).
+// The cell of the first head may be not marked yet. The halting states are left as they are.
+static string track_head_state(const string &state, char side) {
+    if (state == ACCEPTING_STATE || state == REJECTING_STATE)
+        return state;
+    if (side == HEAD_STAY)
+        return state == INITIAL_STATE ? state : make_user_state(state, "bothHeads", 1);
+    return make_user_state(state, "secondHead" + side_name(side), 1);
+}
+
+// The rest of a step after the second head has been moved: what to do at the first head.
+static string track_pending(const string &state_out, const string &letter_out, char dir) {
+    return state_out + "-(" + letter_out + ")-(" + direction_name(dir) + ")";
+}
+
+// Produces the reduction to the layout with two tracks. A step is done:
+// * at once, when both heads are at the same cell,
+// * otherwise the physical head goes from the first head to the second one, makes the step of the second head,
+//   goes back and makes the step of the first head; on the way back it counts the cells (up to 2),
+//   which is enough to tell on which side the second head is after the step.
+// There is no shifting of the tape, the heads are apart as much as in the two-tape machine.
+static void make_track_transitions(const transitions_t &transitions, const ReductionNames &names, transitions_t &res) {
+    const auto &alphabet = names.alphabet;
+    set<pair<string, string>> first_heads; // (state, letter under the first head) seen
+    set<string> pending_steps;
+
+    auto add_pending = [&](const string &state_out, const string &letter_out, char dir, char side) {
+        auto pending = track_pending(state_out, letter_out, dir);
+        if (!pending_steps.insert(pending + side).second)
+            return;
+        auto place = make_user_state(pending, "placeSecondHead" + side_name(side), 2);
+        // e is the distance of the first head from the second one, after the second one has moved
+        auto at_first_head = [&](const string &letter2, int e) {
+            auto written = make_track_letter(names, letter_out, dir == HEAD_STAY, letter2, e == 0);
+            if (e == 0)
+                return make_out(track_head_state(state_out, dir == HEAD_STAY ? HEAD_STAY : opposite(dir)), written, dir);
+            if (dir == side && e == 1)
+                return make_out(track_head_state(state_out, HEAD_STAY), written, dir);
+            return make_out(track_head_state(state_out, side), written, dir);
+        };
+        vector<string> back;
+        for (int e = 1; e <= 2; ++e)
+            back.emplace_back(make_user_state(pending + "-(" + to_string(e) + ")", "backToFirstHead" + side_name(opposite(side)), 1));
+        for (const auto &a: alphabet) {
+            for (const auto &b: alphabet) {
+                auto cell = make_track_letter(names, a, false, b, false);
+                res[make_in(place, cell)] = make_out(back[0], make_track_letter(names, a, false, b, true), opposite(side));
+                res[make_in(place, make_track_letter(names, a, true, b, false))] = at_first_head(b, 0);
+                for (int e = 1; e <= 2; ++e) {
+                    res[make_in(back[e - 1], cell)] = make_out(back[1], cell, opposite(side));
+                    res[make_in(back[e - 1], make_track_letter(names, a, true, b, false))] = at_first_head(b, e);
+                }
+            }
+        }
+    };
+
+    for (const auto &transition: transitions) {
+        const auto &state_in = transition.first.first;
+        const auto &letter_in_tape_1 = transition.first.second[0];
+        const auto &letter_in_tape_2 = transition.first.second[1];
+        const auto &state_out = get<0>(transition.second);
+        const auto &letter_out_tape_1 = get<1>(transition.second)[0];
+        const auto &letter_out_tape_2 = get<1>(transition.second)[1];
+        auto dir_tape_1 = get<2>(transition.second)[0];
+        auto dir_tape_2 = get<2>(transition.second)[1];
+        // A transition to a halting state halts at once, unless a head could fall off the tape.
+        bool halting = (state_out == ACCEPTING_STATE || state_out == REJECTING_STATE)
+            && dir_tape_1 != HEAD_LEFT && dir_tape_2 != HEAD_LEFT;
+
+        // Both heads at the same cell.
+        auto both = track_head_state(state_in, HEAD_STAY);
+        for (auto marks: {make_pair(true, true), make_pair(false, true), make_pair(false, false)}) {
+            auto cell = make_track_letter(names, letter_in_tape_1, marks.first, letter_in_tape_2, marks.second);
+            auto &out = res[make_in(both, cell)];
+            if (halting) {
+                out = make_out(state_out, cell, HEAD_STAY);
+            } else if (dir_tape_1 == dir_tape_2) {
+                bool stay = dir_tape_1 == HEAD_STAY;
+                out = make_out(track_head_state(state_out, HEAD_STAY), make_track_letter(names, letter_out_tape_1, stay, letter_out_tape_2, stay), dir_tape_1);
+            } else if (dir_tape_2 == HEAD_STAY) {
+                out = make_out(track_head_state(state_out, opposite(dir_tape_1)), make_track_letter(names, letter_out_tape_1, false, letter_out_tape_2, true), dir_tape_1);
             } else {
-                auto state_out = get<0>(out) + "-(" + letter2 + ")-(" + letter1 + ")";
-                res[make_in(make_user_state(state_in, extend_tape_back_to_first_tape(letter1), 1), make_logical_head(letter2))] = make_out(make_user_state(state_out, "", 1), make_logical_head(letter2), HEAD_STAY);
+                // The second head is placed first, the first head stays or goes to the other side.
+                string kind = dir_tape_1 == HEAD_STAY ? "placeSecondHeadAndReturn" : "placeSecondHeadAndPass";
+                auto place = make_user_state(state_out, kind + side_name(dir_tape_2), 2);
+                out = make_out(place, make_track_letter(names, letter_out_tape_1, dir_tape_1 == HEAD_STAY, letter_out_tape_2, false), dir_tape_2);
+                auto pass = make_user_state(state_out, "passToFirstHead" + side_name(opposite(dir_tape_2)), 1);
+                auto next = track_head_state(state_out, dir_tape_2);
+                for (const auto &a: alphabet) {
+                    for (const auto &b: alphabet) {
+                        auto cell_ab = make_track_letter(names, a, false, b, false);
+                        res[make_in(place, cell_ab)] = make_out(dir_tape_1 == HEAD_STAY ? next : pass, make_track_letter(names, a, false, b, true), opposite(dir_tape_2));
+                        if (dir_tape_1 != HEAD_STAY)
+                            res[make_in(pass, cell_ab)] = make_out(next, cell_ab, opposite(dir_tape_2));
+                    }
+                }
+            }
+        }
+
+        // The second head on either side: go to it, remembering the letter under the first head.
+        for (char side: {HEAD_LEFT, HEAD_RIGHT}) {
+            auto to_second = make_user_state(state_in + "-(" + letter_in_tape_1 + ")", "toSecondHead" + side_name(side), 2);
+            if (first_heads.insert(make_pair(state_in + side, letter_in_tape_1)).second) {
+                auto first = track_head_state(state_in, side);
+                for (const auto &b: alphabet) {
+                    auto marked = make_track_letter(names, letter_in_tape_1, true, b, false);
+                    res[make_in(first, marked)] = make_out(to_second, marked, side);
+                    res[make_in(first, make_track_letter(names, letter_in_tape_1, false, b, false))] = make_out(to_second, marked, side);
+                    for (const auto &a: alphabet) {
+                        auto cell = make_track_letter(names, a, false, b, false);
+                        res[make_in(to_second, cell)] = make_out(to_second, cell, side);
+                    }
+                }
+            }
+
+            // Make the step of the second head.
+            for (const auto &a: alphabet) {
+                auto cell = make_track_letter(names, a, false, letter_in_tape_2, true);
+                auto &out = res[make_in(to_second, cell)];
+                if (halting) {
+                    out = make_out(state_out, cell, HEAD_STAY);
+                    continue;
+                }
+                add_pending(state_out, letter_out_tape_1, dir_tape_1, side);
+                auto pending = track_pending(state_out, letter_out_tape_1, dir_tape_1);
+                if (dir_tape_2 == HEAD_STAY)
+                    out = make_out(make_user_state(pending + "-(1)", "backToFirstHead" + side_name(opposite(side)), 1),
+                                   make_track_letter(names, a, false, letter_out_tape_2, true), opposite(side));
+                else
+                    out = make_out(make_user_state(pending, "placeSecondHead" + side_name(side), 2),
+                                   make_track_letter(names, a, false, letter_out_tape_2, false), dir_tape_2);
+            }
+        }
+    }
+}
+
+// Produces the reduction in which the physical head walks between the heads alternately to the right and to the left.
+// A walk carries the new state, the letter under the head it has left and the pending part of the step
+// of the head it goes to. At that head it makes the pending part, reads the letter under the head
+// and makes the part of the next step of this head at once. So a step of the two-tape machine takes
+// a single walk between the heads, instead of a walk to the second head and back.
+// The states are made when they are first used.
+class BoustrophedonReduction {
+public:
+    BoustrophedonReduction(const transitions_t &transitions_, const ReductionNames &names_, transitions_t &res_)
+        : transitions(transitions_), names(names_), res(res_) {
+    }
+
+    void make() {
+        // The init states leave the physical head at the first head, the second tape is empty.
+        for (size_t a = 0; a < names.alphabet.size(); ++a)
+            add(INIT_BACK_TO_FRONT, names.heads[a], at_first_head(INITIAL_STATE, names.alphabet[a], BLANK));
+        while (!todo.empty()) {
+            auto make_state = todo.back();
+            todo.pop_back();
+            make_state();
+        }
+    }
+
+private:
+    typedef tuple<string, vector<string>, string> out_t;
+
+    const transitions_t &transitions;
+    const ReductionNames &names;
+    transitions_t &res;
+    set<string> made;
+    vector<function<void()>> todo;
+    out_t none;
+
+    static bool halting(const string &state) {
+        return state == ACCEPTING_STATE || state == REJECTING_STATE;
+    }
+
+    void add(const string &state, const string &letter, const out_t &out) {
+        if (out != none)
+            res[make_in(state, letter)] = out;
+    }
+
+    // Schedules making the transitions of the state, if it is new.
+    const string &use(const string &state, const function<void()> &make_state) {
+        if (made.insert(state).second)
+            todo.push_back(make_state);
+        return state;
+    }
+
+    const out_t *find(const string &state, const string &letter1, const string &letter2) const {
+        auto it = transitions.find(make_pair(state, vector<string>{letter1, letter2}));
+        return it == transitions.end() ? nullptr : &it->second;
+    }
+
+    static string pending(const string &state, const string &letter, char dir) {
+        return state + "-(" + letter + ")-(" + direction_name(dir) + ")";
+    }
+
+    // The physical head is at the first head, which is over letter1.
+    out_t at_first_head(const string &state, const string &letter1, const string &letter2) {
+        if (halting(state))
+            return make_out(state, letter1, HEAD_STAY);
+        auto out = find(state, letter1, letter2);
+        if (!out)
+            return none;
+        const auto &state_out = get<0>(*out);
+        auto letter_out_tape_1 = get<1>(*out)[0], letter_out_tape_2 = get<1>(*out)[1];
+        auto dir_tape_1 = get<2>(*out)[0], dir_tape_2 = get<2>(*out)[1];
+        if (halting(state_out) && dir_tape_2 != HEAD_LEFT)
+            return make_out(state_out, letter_out_tape_1, dir_tape_1);
+        if (dir_tape_1 == HEAD_STAY)
+            return make_out(to_second_head(state_out, letter_out_tape_1, letter_out_tape_2, dir_tape_2),
+                            make_logical_head(letter_out_tape_1, names.parentheses), HEAD_RIGHT);
+        return make_out(mark_first_head(state_out, letter_out_tape_2, dir_tape_2), letter_out_tape_1, dir_tape_1);
+    }
+
+    // The physical head is at the second head, which is over letter2.
+    out_t at_second_head(const string &state, const string &letter1, const string &letter2) {
+        if (halting(state))
+            return make_out(state, letter2, HEAD_STAY);
+        auto out = find(state, letter1, letter2);
+        if (!out)
+            return none;
+        const auto &state_out = get<0>(*out);
+        auto letter_out_tape_1 = get<1>(*out)[0], letter_out_tape_2 = get<1>(*out)[1];
+        auto dir_tape_1 = get<2>(*out)[0], dir_tape_2 = get<2>(*out)[1];
+        if (halting(state_out) && dir_tape_1 != HEAD_LEFT && dir_tape_2 != HEAD_LEFT)
+            return make_out(state_out, letter_out_tape_2, HEAD_STAY);
+        if (dir_tape_2 == HEAD_STAY)
+            return make_out(to_first_head(state_out, letter_out_tape_2, letter_out_tape_1, dir_tape_1),
+                            make_logical_head(letter_out_tape_2, names.parentheses), HEAD_LEFT);
+        return make_out(mark_second_head(state_out, letter_out_tape_1, dir_tape_1), letter_out_tape_2, dir_tape_2);
+    }
+
+    // Walk to the right, to make the pending part of the step at the second head.
+    string to_second_head(const string &state, const string &letter1, const string &letter2, char dir) {
+        auto name = make_user_state(pending(state + "-(" + letter1 + ")", letter2, dir), TO_SECOND_TAPE, 1);
+        return use(name, [=]() {
+            for (size_t a = 0; a < names.alphabet.size(); ++a) {
+                add(name, names.alphabet[a], make_out(name, names.alphabet[a], HEAD_RIGHT));
+                if (dir == HEAD_STAY)
+                    add(name, names.heads[a], at_second_head(state, letter1, letter2));
+                else
+                    add(name, names.heads[a], make_out(second_head_moved(state, letter1), letter2, dir));
+            }
+            add(name, names.tape_border, make_out(name, names.tape_border, HEAD_RIGHT));
+        });
+    }
+
+    // Walk to the left, to make the pending part of the step at the first head.
+    string to_first_head(const string &state, const string &letter2, const string &letter1, char dir) {
+        auto name = make_user_state(pending(state + "-(" + letter2 + ")", letter1, dir), "toFirstTape", 2);
+        return use(name, [=]() {
+            for (size_t a = 0; a < names.alphabet.size(); ++a) {
+                add(name, names.alphabet[a], make_out(name, names.alphabet[a], HEAD_LEFT));
+                if (dir == HEAD_STAY)
+                    add(name, names.heads[a], at_first_head(state, letter1, letter2));
+                else
+                    add(name, names.heads[a], make_out(first_head_moved(state, letter2), letter1, dir));
+            }
+            add(name, names.tape_border, make_out(name, names.tape_border, HEAD_LEFT));
+        });
+    }
+
+    // The second head has just moved, the letter under it decides the next step.
+    string second_head_moved(const string &state, const string &letter1) {
+        auto prefix = state + "-(" + letter1 + ")";
+        auto name = make_user_state(prefix, "secondHeadMoved", 2);
+        return use(name, [=]() {
+            for (const auto &letter: names.alphabet)
+                add(name, letter, at_second_head(state, letter1, letter));
+            // Extend second tape if necessary, the head falls off it at the tape border.
+            auto end = make_user_state(prefix, EXT_TAPE_TAPE_END, 2);
+            add(name, names.tape_end, make_out(end, BLANK, HEAD_RIGHT));
+            add(end, BLANK, make_out(name, names.tape_end, HEAD_LEFT));
+        });
+    }
+
+    // The first head has just moved, the letter under it decides the next step.
+    string first_head_moved(const string &state, const string &letter2) {
+        auto prefix = state + "-(" + letter2 + ")";
+        auto name = make_user_state(prefix, "firstHeadMoved", 1);
+        return use(name, [=]() {
+            for (const auto &letter: names.alphabet)
+                add(name, letter, at_first_head(state, letter, letter2));
+            shift_second_tape(prefix, name);
+        });
+    }
+
+    // The second head has made its part of the step, mark the cell it has moved to.
+    string mark_second_head(const string &state, const string &letter1, char dir) {
+        auto prefix = pending(state, letter1, dir);
+        auto name = make_user_state(prefix, "markSecondHead", 2);
+        return use(name, [=]() {
+            for (size_t a = 0; a < names.alphabet.size(); ++a)
+                add(name, names.alphabet[a], make_out(to_first_head(state, names.alphabet[a], letter1, dir), names.heads[a], HEAD_LEFT));
+            // Extend second tape if necessary, the head falls off it at the tape border.
+            auto end = make_user_state(prefix, EXT_TAPE_TAPE_END, 2);
+            auto leave = make_user_state(prefix, "leaveSecondHead", 2);
+            auto blank_head = make_logical_head(BLANK, names.parentheses);
+            add(name, names.tape_end, make_out(end, blank_head, HEAD_RIGHT));
+            add(end, BLANK, make_out(leave, names.tape_end, HEAD_LEFT));
+            add(leave, blank_head, make_out(to_first_head(state, BLANK, letter1, dir), blank_head, HEAD_LEFT));
+        });
+    }
+
+    // The first head has made its part of the step, mark the cell it has moved to.
+    string mark_first_head(const string &state, const string &letter2, char dir) {
+        auto prefix = pending(state, letter2, dir);
+        auto name = make_user_state(prefix, "markFirstHead", 1);
+        return use(name, [=]() {
+            for (size_t a = 0; a < names.alphabet.size(); ++a)
+                add(name, names.alphabet[a], make_out(to_second_head(state, names.alphabet[a], letter2, dir), names.heads[a], HEAD_RIGHT));
+            shift_second_tape(prefix, name);
+        });
+    }
+
+    // The first head has moved onto the tape border: shift the second tape right by one cell
+    // and come back to the new blank cell of the first tape in state back.
+    void shift_second_tape(const string &prefix, const string &back) {
+        size_t n = names.alphabet.size();
+        auto border = make_user_state(prefix, EXT_TAPE_TAPE_BORDER, 1);
+        auto end = make_user_state(prefix, EXT_TAPE_TAPE_END, 1);
+        auto move_back = make_user_state(prefix, EXT_TAPE_MOVE_BACK, 1);
+        vector<string> cells, extend;
+        for (size_t a = 0; a < n; ++a) {
+            cells.emplace_back(names.alphabet[a]);
+            extend.emplace_back(make_user_state(prefix, names.extend_letters[a], 1));
+            cells.emplace_back(names.heads[a]);
+            extend.emplace_back(make_user_state(prefix, names.extend_heads[a], 1));
+        }
+        add(back, names.tape_border, make_out(border, BLANK, HEAD_RIGHT));
+        for (size_t a = 0; a < cells.size(); ++a) {
+            add(border, cells[a], make_out(extend[a], names.tape_border, HEAD_RIGHT));
+            for (size_t b = 0; b < cells.size(); ++b)
+                add(extend[a], cells[b], make_out(extend[b], cells[a], HEAD_RIGHT));
+            add(extend[a], names.tape_end, make_out(end, cells[a], HEAD_RIGHT));
+            add(move_back, cells[a], make_out(move_back, cells[a], HEAD_LEFT));
+        }
+        add(end, BLANK, make_out(move_back, names.tape_end, HEAD_LEFT));
+        add(move_back, names.tape_border, make_out(back, names.tape_border, HEAD_LEFT));
+    }
+};
+
+typedef vector<pair<transitions_t::key_type, transitions_t::mapped_type>> fragment_t; // sorted by the keys
+
+// Merges sorted fragments into one table, in the order of the keys.
+// A key produced by more than one fragment has to have the same value in each of them.
+static transitions_t merge_fragments(vector<fragment_t> &fragments) {
+    typedef pair<size_t, size_t> position_t; // (fragment, index in it)
+    auto later = [&](const position_t &a, const position_t &b) {
+        const auto &key_a = fragments[a.first][a.second].first;
+        const auto &key_b = fragments[b.first][b.second].first;
+        if (key_a != key_b)
+            return key_b < key_a;
+        return b.first < a.first;
+    };
+    priority_queue<position_t, vector<position_t>, decltype(later)> heads(later);
+    for (size_t a = 0; a < fragments.size(); ++a)
+        if (!fragments[a].empty())
+            heads.push({a, 0});
+
+    transitions_t res;
+    while (!heads.empty()) {
+        auto position = heads.top();
+        heads.pop();
+        auto &transition = fragments[position.first][position.second];
+        if (!res.empty() && prev(res.end())->first == transition.first) {
+            if (prev(res.end())->second != transition.second)
+                machine_error("Conflicting transitions from state " + transition.first.first + " in the reduction");
+        } else {
+            res.emplace_hint(res.end(), move(transition));
+        }
+        if (++position.second < fragments[position.first].size())
+            heads.push(position);
+    }
+    return res;
+}
+
+// Finds the transitions which can be used in a run and the letters which can appear on each tape:
+// the input letters and the blank on the first tape, the blank on the second one,
+// and the letters written by such transitions, which start in the reachable states.
+// Sets names.letters1 and names.letters2, the helper states are made only for these letters.
+static vector<transitions_t::const_iterator> reachable_transitions(const transitions_t &transitions,
+                                                                   const vector<string> &input_alphabet,
+                                                                   ReductionNames &names) {
+    vector<bool> on_tape_1(names.alphabet.size(), false), on_tape_2(names.alphabet.size(), false);
+    on_tape_1[names.letter_ids.at(BLANK)] = on_tape_2[names.letter_ids.at(BLANK)] = true;
+    for (const auto &letter: input_alphabet)
+        on_tape_1[names.letter_ids.at(letter)] = true;
+    auto can_appear = [&](const transitions_t::value_type &transition) {
+        return on_tape_1[names.letter_ids.at(transition.first.second[0])]
+            && on_tape_2[names.letter_ids.at(transition.first.second[1])];
+    };
+
+    // A state is scanned again whenever a new letter appears, which happens at most once per letter and tape.
+    set<string> reachable = {INITIAL_STATE};
+    vector<string> todo = {INITIAL_STATE};
+    while (!todo.empty()) {
+        bool new_letter = false;
+        while (!todo.empty()) {
+            string state = todo.back();
+            todo.pop_back();
+            for (auto it = transitions.lower_bound(make_pair(state, vector<string>())); it != transitions.end() && it->first.first == state; ++it) {
+                if (!can_appear(*it))
+                    continue;
+                for (int tape = 0; tape < 2; ++tape) {
+                    auto &on_tape = tape ? on_tape_2 : on_tape_1;
+                    auto letter = names.letter_ids.at(get<1>(it->second)[tape]);
+                    new_letter |= !on_tape[letter];
+                    on_tape[letter] = true;
+                }
+                if (reachable.insert(get<0>(it->second)).second)
+                    todo.push_back(get<0>(it->second));
             }
         }
+        if (new_letter)
+            todo.assign(reachable.begin(), reachable.end());
     }
 
+    names.letters1.clear();
+    names.letters2.clear();
+    for (size_t a = 0; a < names.alphabet.size(); ++a) {
+        if (on_tape_1[a])
+            names.letters1.push_back(a);
+        if (on_tape_2[a])
+            names.letters2.push_back(a);
+    }
+    vector<transitions_t::const_iterator> res;
+    for (auto it = transitions.begin(); it != transitions.end(); ++it)
+        if (reachable.count(it->first.first) && can_appear(*it))
+            res.push_back(it);
     return res;
 }
 
-TuringMachine TuringMachine::reduce_two_tapes_to_one() {
+TuringMachine TuringMachine::reduce_two_tapes_to_one(reduction_t reduction, unsigned num_threads, unsigned gap) {
+    assert(num_tapes == 2 && "Number of tapes different from 2");
+    assert(gap >= 1 && (gap == 1 || reduction == REDUCTION_PER_TRANSITION));
+    ReductionNames names(working_alphabet(), gap);
+
+    if (reduction == REDUCTION_TRACKS) {
+        transitions_t new_transitions;
+        make_track_transitions(transitions, names, new_transitions);
+        return TuringMachine(1, input_alphabet, new_transitions);
+    }
+
+    auto init_states = make_init_states(input_alphabet, names);
+
+    if (reduction == REDUCTION_BOUSTROPHEDON) {
+        transitions_t new_transitions = init_states;
+        BoustrophedonReduction(transitions, names, new_transitions).make();
+        return TuringMachine(1, input_alphabet, new_transitions);
+    }
+
+    if (reduction == REDUCTION_SHARED_HELPERS) {
+        // the helper states are shared, so the transitions cannot be reduced separately
+        transitions_t new_transitions = init_states;
+        make_shared_one_tape_transitions(transitions, names, new_transitions);
+        return TuringMachine(1, input_alphabet, new_transitions);
+    }
+
+    // The fragments of the transitions are independent, every worker has its own cache of the names.
+    auto sources = reachable_transitions(transitions, input_alphabet, names);
+    vector<fragment_t> fragments(sources.size() + 1);
+    fragments[0].assign(init_states.begin(), init_states.end());
+    if (num_threads > sources.size())
+        num_threads = max<size_t>(sources.size(), 1);
+    vector<ReductionNames> worker_names(max(num_threads, 1u), names);
+    parallel_for(sources.size(), num_threads, [&](unsigned worker, size_t i) {
+        transitions_t fragment;
+        make_one_tape_transitions_from_two(sources[i]->first, sources[i]->second, worker_names[worker], fragment);
+        fragments[i + 1].assign(make_move_iterator(fragment.begin()), make_move_iterator(fragment.end()));
+    });
+
+    return TuringMachine(1, input_alphabet, merge_fragments(fragments));
+}
+
+// Writes a machine in the format of save_to_file through a large buffer.
+class TransitionWriter {
+public:
+    TransitionWriter(FILE *output_, int num_tapes_, const vector<string> &input_alphabet)
+        : output(output_), num_tapes(num_tapes_), ok(true) {
+        buffer.reserve(BUFFER_SIZE);
+        buffer += NUM_TAPES " " + to_string(num_tapes) + "\n" INPUT_ALPHABET;
+        for (const auto &letter : input_alphabet)
+            write_token(letter);
+        buffer += '\n';
+    }
+
+    void write(const transitions_t::key_type &in, const transitions_t::mapped_type &out) {
+        buffer += in.first;
+        for (const auto &letter : in.second)
+            write_token(letter);
+        write_token(get<0>(out));
+        for (const auto &letter : get<1>(out))
+            write_token(letter);
+        for (int a = 0; a < num_tapes; ++a) {
+            buffer += ' ';
+            buffer += get<2>(out)[a];
+        }
+        buffer += '\n';
+        if (buffer.size() >= BUFFER_SIZE)
+            flush();
+    }
+
+    void write(const transitions_t &transitions) {
+        for (const auto &transition : transitions)
+            write(transition.first, transition.second);
+    }
+
+    // returns false if writing failed
+    bool flush() {
+        if (!buffer.empty() && fwrite(buffer.data(), 1, buffer.size(), output) != buffer.size())
+            ok = false;
+        buffer.clear();
+        return ok;
+    }
+
+private:
+    static const size_t BUFFER_SIZE = 1 << 22;
+
+    FILE *output;
+    int num_tapes;
+    bool ok;
+    string buffer;
+
+    void write_token(const string &token) {
+        buffer += ' ';
+        buffer += token;
+    }
+};
+
+bool TuringMachine::save_reduction_to_file(FILE *output, reduction_t reduction, unsigned num_threads, bool generation_order,
+                                           unsigned gap) {
     assert(num_tapes == 2 && "Number of tapes different from 2");
-    set_number_of_parentheses(working_alphabet());
-    set_tape_border();
-    set_tape_end();
+    assert(gap >= 1 && (gap == 1 || reduction == REDUCTION_PER_TRANSITION));
+    if (reduction != REDUCTION_PER_TRANSITION) {
+        TransitionWriter writer(output, 1, input_alphabet);
+        writer.write(reduce_two_tapes_to_one(reduction).transitions);
+        return writer.flush();
+    }
 
-    transitions_t new_transitions;
+    ReductionNames names(working_alphabet(), gap);
+    TransitionWriter writer(output, 1, input_alphabet);
+
+    // All the states of the fragment of a transition start with "(U-<state>-(<letter>)-(<letter>)-",
+    // apart from (init-backToFront), which comes after all of them, like the other init states.
+    // Reduced in the order of these prefixes, a transition is written as soon as no fragment left can precede it.
+    vector<pair<string, transitions_t::const_iterator>> sources;
+    for (auto it : reachable_transitions(transitions, input_alphabet, names))
+        sources.emplace_back("(U-" + it->first.first + "-(" + it->first.second[0] + ")-(" + it->first.second[1] + ")-", it);
+    if (!generation_order)
+        sort(sources.begin(), sources.end(), [](const pair<string, transitions_t::const_iterator> &a,
+                                                const pair<string, transitions_t::const_iterator> &b) {
+            return a.first < b.first;
+        });
+
+    transitions_t pending;
+    auto init_states = make_init_states(input_alphabet, names);
+    if (generation_order)
+        writer.write(init_states);
+    else
+        pending = init_states;
+
+    if (num_threads > sources.size())
+        num_threads = max<size_t>(sources.size(), 1);
+    vector<ReductionNames> worker_names(max(num_threads, 1u), names);
+    vector<transitions_t> fragments(64 * worker_names.size());
+    for (size_t batch = 0; batch < sources.size(); batch += fragments.size()) {
+        size_t batch_size = min(fragments.size(), sources.size() - batch);
+        parallel_for(batch_size, num_threads, [&](unsigned worker, size_t i) {
+            const auto &transition = *sources[batch + i].second;
+            fragments[i].clear();
+            make_one_tape_transitions_from_two(transition.first, transition.second, worker_names[worker], fragments[i]);
+        });
+
+        for (size_t i = 0; i < batch_size; ++i) {
+            if (generation_order) {
+                writer.write(fragments[i]);
+                continue;
+            }
+            for (auto &transition : fragments[i]) {
+                auto it = pending.lower_bound(transition.first);
+                if (it == pending.end() || it->first != transition.first)
+                    pending.emplace_hint(it, move(transition));
+                else if (it->second != transition.second)
+                    machine_error("Conflicting transitions from state " + transition.first.first + " in the reduction");
+            }
+            const string *bound = batch + i + 1 < sources.size() ? &sources[batch + i + 1].first : nullptr;
+            while (!pending.empty() && bound && pending.begin()->first.first < *bound) {
+                writer.write(pending.begin()->first, pending.begin()->second);
+                pending.erase(pending.begin());
+            }
+        }
+    }
+    writer.write(pending);
+    return writer.flush();
+}
 
-    auto init_states = make_init_states(input_alphabet);
-    new_transitions.insert(init_states.begin(), init_states.end());
+LazyReduction::LazyReduction(const TuringMachine &tm)
+    : input_alphabet(tm.input_alphabet), names(new ReductionNames(tm.working_alphabet())) {
+    assert(tm.num_tapes == 2 && "Number of tapes different from 2");
+    // the same transitions and letters as in reduce_two_tapes_to_one, so the transitions are the same
+    for (auto it : reachable_transitions(tm.transitions, input_alphabet, *names))
+        sources.insert(*it);
+    for (size_t a = 0; a < names->alphabet.size(); ++a)
+        head_letters[names->heads[a]] = names->alphabet[a];
+}
 
+LazyReduction::~LazyReduction() {
+}
 
-    for (auto transition: transitions) {
-        auto nt = make_one_tape_transitions_from_two(transition.first, transition.second, working_alphabet());
-        new_transitions.insert(nt.begin(), nt.end());
+TuringMachine LazyReduction::start_machine() const {
+    return TuringMachine(1, input_alphabet, make_init_states(input_alphabet, *names));
+}
+
+vector<string> LazyReduction::letters() const {
+    set<string> res(names->alphabet.begin(), names->alphabet.end());
+    res.insert(names->heads.begin(), names->heads.end());
+    res.insert(names->tape_border);
+    res.insert(names->tape_end);
+    return vector<string>(res.begin(), res.end());
+}
+
+// reads the source transition from the name of one of its states, "(U-<state>-(<letter>)-(<letter>)-...";
+// returns the position after the letters, or string::npos if it is not a state of a source transition
+static size_t parse_user_state(const string &state, transitions_t::key_type &key) {
+    const string prefix = "(U-";
+    if (state.compare(0, prefix.length(), prefix) != 0)
+        return string::npos;
+    size_t pos = prefix.length();
+    if (!check_identifier(state, pos))
+        return string::npos;
+    key.first = state.substr(prefix.length(), pos - prefix.length());
+    key.second.clear();
+    for (int tape = 0; tape < 2; ++tape) {
+        size_t begin = pos + 1;
+        if (pos >= state.length() || state[pos] != '-' || begin >= state.length() || state[begin] != '(')
+            return string::npos;
+        pos = begin;
+        if (!check_identifier(state, pos))
+            return string::npos;
+        key.second.push_back(state.substr(begin + 1, pos - begin - 2));
     }
+    return pos;
+}
 
-    return TuringMachine(1, input_alphabet, new_transitions);
+bool LazyReduction::make_transitions(const string &state, const string &letter, transitions_t &res) {
+    // only (init-backToFront) on a logical head belongs to a source transition from (start)
+    transitions_t::key_type key;
+    if (state == INIT_BACK_TO_FRONT) {
+        auto it = head_letters.find(letter);
+        if (it == head_letters.end())
+            return false;
+        key = make_pair(INITIAL_STATE, vector<string>{it->second, BLANK});
+    } else if (parse_user_state(state, key) == string::npos)
+        return false;
+    auto it = sources.find(key);
+    if (it == sources.end() || !made.insert(key).second)
+        return false;
+    make_one_tape_transitions_from_two(it->first, it->second, *names, res);
+    return true;
+}
+
+ReductionDecoder::ReductionDecoder(const TuringMachine &tm) {
+    assert(tm.num_tapes == 2 && "Number of tapes different from 2");
+    ReductionNames names(tm.working_alphabet());
+    for (size_t a = 0; a < names.alphabet.size(); ++a) {
+        cells[names.alphabet[a]] = make_pair(REDUCED_LETTER, names.alphabet[a]);
+        cells[names.heads[a]] = make_pair(REDUCED_HEAD, names.alphabet[a]);
+    }
+    cells[names.tape_border] = make_pair(REDUCED_BORDER, "");
+    cells[names.tape_end] = make_pair(REDUCED_END, "");
+    cells[names.tape_padding] = make_pair(REDUCED_PADDING, "");
+}
+
+reduced_cell_t ReductionDecoder::decode_letter(const string &letter, string &source_letter) const {
+    auto it = cells.find(letter);
+    if (it == cells.end())
+        return REDUCED_OTHER;
+    source_letter = it->second.second;
+    return it->second.first;
+}
+
+bool ReductionDecoder::decode_step_start(const string &state, string &source_state,
+                                         vector<string> &under_heads) const {
+    // the first state of a source transition, "(U-<state>-(<letter>)-(<letter>)--1)"
+    transitions_t::key_type key;
+    size_t pos = parse_user_state(state, key);
+    if (pos == string::npos || state.compare(pos, string::npos, "--1)") != 0)
+        return false;
+    source_state = key.first;
+    under_heads = key.second;
+    return true;
 }
@@ -4,6 +4,8 @@
 #include <cstdio>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <set>
 #include <string>
 #include <tuple>
 #include <utility>
@@ -25,6 +27,17 @@
 #define HEAD_RIGHT '>'
 #define HEAD_STAY '-'
 
+// how the reduction of two tapes to one builds the helper states:
+enum reduction_t {
+    REDUCTION_PER_TRANSITION, // every source transition has its own copies of the helper states
+    REDUCTION_SHARED_HELPERS, // the helper states carry only the pending work and are shared
+    REDUCTION_TRACKS, // every cell holds a cell of both tapes, so the second tape is never shifted
+    REDUCTION_BOUSTROPHEDON, // the physical head makes a step on every walk between the heads, in either direction
+};
+
+// the largest gap of a reduction: the states of a shift hold up to gap cells of the second tape
+const unsigned MAX_GAP = 4;
+
 typedef std::map<std::pair<std::string, std::vector<std::string>>, std::tuple<std::string, std::vector<std::string>, std::string>> transitions_t;
 
 struct TuringMachine {
@@ -47,7 +60,82 @@ struct TuringMachine {
     std::vector<std::string> parse_input(std::string input) const;
     // ERROR <=> input!="" && returned_value.empty()
 
-    TuringMachine reduce_two_tapes_to_one();
+    // the transitions are reduced on num_threads threads (only in REDUCTION_PER_TRANSITION);
+    // the result does not depend on the number of threads;
+    // when the first tape grows, the second one is shifted by gap cells at once (only in REDUCTION_PER_TRANSITION),
+    // the cells between them are padding used by the next cells of the first tape;
+    // in REDUCTION_PER_TRANSITION only the transitions usable in a run are reduced and the helper states
+    // handle only the letters which can appear on the tape they walk over
+    TuringMachine reduce_two_tapes_to_one(reduction_t reduction = REDUCTION_PER_TRANSITION, unsigned num_threads = 1,
+                                          unsigned gap = 1);
+
+    // writes reduce_two_tapes_to_one(reduction) as save_to_file would, but in REDUCTION_PER_TRANSITION
+    // without keeping the whole result in memory; with generation_order the transitions are written
+    // in the order they are made instead of the sorted one; returns false if writing failed
+    bool save_reduction_to_file(FILE *output, reduction_t reduction = REDUCTION_PER_TRANSITION,
+                                unsigned num_threads = 1, bool generation_order = false, unsigned gap = 1);
+};
+
+// whether the letter is the padding between the tapes in a reduced machine
+bool is_tape_padding(const std::string &letter);
+
+// whether the name is a single identifier, as described above
+bool is_identifier(const std::string &name);
+
+struct ReductionNames;
+
+// The reduction of a two-tape machine to one tape (REDUCTION_PER_TRANSITION) made piece by piece:
+// the transitions of a source transition are made only when a run gets to one of its states.
+class LazyReduction {
+public:
+    explicit LazyReduction(const TuringMachine &tm);
+    ~LazyReduction();
+
+    // the one-tape machine with the transitions which are made at once (of the init states)
+    TuringMachine start_machine() const;
+
+    // all the letters the one-tape machine can write
+    std::vector<std::string> letters() const;
+
+    // makes the transitions of the source transition which the transition from the state on the letter belongs to;
+    // returns false if there is no such source transition or its transitions were made already
+    bool make_transitions(const std::string &state, const std::string &letter, transitions_t &res);
+
+private:
+    std::vector<std::string> input_alphabet;
+    transitions_t sources; // the source transitions usable in a run
+    std::unique_ptr<ReductionNames> names;
+    std::set<transitions_t::key_type> made;
+    std::map<std::string, std::string> head_letters; // logical head -> its letter
+};
+
+// the cells of the reduction (REDUCTION_PER_TRANSITION): [first tape] tape-border [second tape] tape-end,
+// with the logical heads marking the cells under the heads and the padding between the tapes (with a gap)
+enum reduced_cell_t {
+    REDUCED_LETTER,
+    REDUCED_HEAD,
+    REDUCED_BORDER,
+    REDUCED_END,
+    REDUCED_PADDING,
+    REDUCED_OTHER, // not a letter of the reduction
+};
+
+// Reads the configurations of a two-tape machine back from the configurations of its reduction
+// (REDUCTION_PER_TRANSITION), e.g. to compare their runs step by step.
+class ReductionDecoder {
+public:
+    explicit ReductionDecoder(const TuringMachine &tm);
+
+    // the kind of the letter of the reduction, and the letter of the two-tape machine held by a letter or a head
+    reduced_cell_t decode_letter(const std::string &letter, std::string &source_letter) const;
+
+    // whether the reduction in the state is about to simulate a step of the two-tape machine,
+    // with the whole configuration of the two-tape machine on the tape;
+    // the step is made from source_state on the letters under_heads
+    bool decode_step_start(const std::string &state, std::string &source_state, std::vector<std::string> &under_heads) const;
+
+private:
+    std::map<std::string, std::pair<reduced_cell_t, std::string>> cells;
 };
 
 static inline std::ostream &operator<<(std::ostream &output, const TuringMachine &tm) {
@@ -55,6 +143,26 @@ static inline std::ostream &operator<<(std::ostream &output, const TuringMachine
     return output;
 }
 
+// reads a machine and closes the file; a syntax error is printed and the program exits (or it is thrown
+// as MachineError inside a MachineErrorScope)
 TuringMachine read_tm_from_file(FILE *input);
 
+// An error in a machine or in a machine file. It is printed and the program exits,
+// unless it happens inside a MachineErrorScope on the same thread, where it is thrown as MachineError,
+// so that a library call can report it to its caller.
+struct MachineError {
+    std::string message;
+};
+
+class MachineErrorScope {
+public:
+    MachineErrorScope();
+    ~MachineErrorScope();
+
+    // whether the errors on this thread are thrown
+    static bool active();
+};
+
+[[noreturn]] void machine_error(const std::string &message);
+
 #endif
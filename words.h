@@ -0,0 +1,39 @@
+#ifndef __WORDS_H
+#define __WORDS_H
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+// Every word over the alphabet up to max_length (shorter ones first, each length in lexicographic order
+// of the reversed words), except that a length with more than num_words words gets only num_words
+// random words; the random words depend only on the seed.
+static inline std::vector<std::vector<std::string>> make_words(const std::vector<std::string> &alphabet,
+                                                               size_t max_length, size_t num_words, uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    std::vector<std::vector<std::string>> res;
+    size_t all = 1; // the number of words of the length, while it is at most num_words
+    for (size_t length = 0; length <= max_length; ++length) {
+        if (all <= num_words) {
+            for (size_t index = 0; index < all; ++index) {
+                std::vector<std::string> word;
+                for (size_t rest = index, a = 0; a < length; ++a, rest /= alphabet.size())
+                    word.push_back(alphabet[rest % alphabet.size()]);
+                res.emplace_back(word);
+            }
+        } else {
+            for (size_t index = 0; index < num_words; ++index) {
+                std::vector<std::string> word;
+                for (size_t a = 0; a < length; ++a)
+                    word.push_back(alphabet[rng() % alphabet.size()]);
+                res.emplace_back(word);
+            }
+        }
+        if (all <= num_words)
+            all *= alphabet.size();
+    }
+    return res;
+}
+
+#endif